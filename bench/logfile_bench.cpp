@@ -0,0 +1,315 @@
+/* SPDX-License-Identifier: MIT */
+// Cost of logging on the producer side, and throughput of the sinks.
+//
+// producer: every call of SuS_LOG, SuS_LOG_STREAM and SuS_LOG_PRINTF is
+//    timed, with 1 to 64 threads logging at once, once for a level that is
+//    filtered at run time and once for one that is delivered (to a sink
+//    discarding everything).
+// throughput: one thread logs as fast as it can into the stdout sink (to
+//    a discarding stream), the file sink, the capture sink and the null
+//    sink. Measured until the sink has written the last message.
+//
+// The file sink writes into a new directory in /tmp, which is removed
+// afterwards, unless -d is given.
+//
+// Every result is written as one JSON object per line, so that runs of
+// different releases can be compared by a script. Use -o for that: the
+// library prints a line "exit" to stdout when the program ends.
+//
+//   logfile-bench -o results.json
+//   logfile-bench -t 8 -n 5000 -m 100000
+#include "logger.h"
+#include "logger_metrics.h"
+#include "output_stream.h"
+#include "output_stream_capture.h"
+#include "output_stream_file.h"
+#include "output_stream_null.h"
+#include "output_stream_stdout.h"
+#include "subsystem_registrator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <unistd.h>
+
+namespace {
+SuS::logfile::subsystem_registrator log_id{"bench"};
+
+typedef std::chrono::steady_clock clock_type;
+
+//! Where the results go.
+std::FILE *s_results;
+
+//! Stream buffer throwing everything away: measures the formatting of the
+//! stdout sink without a terminal.
+class null_buffer : public std::streambuf {
+ protected:
+   int overflow(int _c) override {
+      return _c;
+   }
+   std::streamsize xsputn(const char *, std::streamsize _n) override {
+      return _n;
+   }
+};
+
+enum class macro_type { log, stream, printf };
+
+const char *macro_name(macro_type _m) {
+   switch (_m) {
+   case macro_type::log:
+      return "SuS_LOG";
+   case macro_type::stream:
+      return "SuS_LOG_STREAM";
+   case macro_type::printf:
+      return "SuS_LOG_PRINTF";
+   }
+   return "?";
+}
+
+//! One timed call. info is delivered, finest is filtered at run time.
+long long timed_call(macro_type _m, bool _filtered, unsigned _i) {
+   const auto start = clock_type::now();
+   if (_filtered) {
+      switch (_m) {
+      case macro_type::log:
+         SuS_LOG(finest, log_id(), "benchmark message");
+         break;
+      case macro_type::stream:
+         SuS_LOG_STREAM(finest, log_id(), "benchmark message " << _i);
+         break;
+      case macro_type::printf:
+         SuS_LOG_PRINTF(finest, log_id(), "benchmark message %u", _i);
+         break;
+      }
+   } else {
+      switch (_m) {
+      case macro_type::log:
+         SuS_LOG(info, log_id(), "benchmark message");
+         break;
+      case macro_type::stream:
+         SuS_LOG_STREAM(info, log_id(), "benchmark message " << _i);
+         break;
+      case macro_type::printf:
+         SuS_LOG_PRINTF(info, log_id(), "benchmark message %u", _i);
+         break;
+      }
+   }
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(
+         clock_type::now() - start)
+         .count();
+}
+
+//! Wait until _sink has written _messages in total.
+/*!
+ * An empty queue is not enough: the log thread takes all events at once, so
+ * it may still be writing them.
+ */
+void drain(const SuS::logfile::output_stream *_sink,
+      unsigned long long _messages) {
+   while (_sink->written() < _messages) {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+   }
+}
+
+//! @param _sink The null sink. Written to, unless _filtered.
+void producer(SuS::logfile::output_stream *_sink, macro_type _m,
+      bool _filtered, unsigned _threads, unsigned _calls) {
+   const auto before = _sink->written();
+   std::vector<std::vector<long long>> latencies(_threads);
+   std::atomic<unsigned> ready{0U};
+   std::vector<std::thread> threads;
+   const auto start = clock_type::now();
+   for (unsigned t = 0U; t < _threads; ++t) {
+      threads.emplace_back([&, t]() {
+         auto &l = latencies[t];
+         l.reserve(_calls);
+         // start together, so that the threads really compete.
+         ++ready;
+         while (ready < _threads) {
+            std::this_thread::yield();
+         }
+         for (unsigned i = 0U; i < _calls; ++i) {
+            l.push_back(timed_call(_m, _filtered, i));
+         }
+      });
+   }
+   for (auto &t : threads) {
+      t.join();
+   }
+   const auto seconds =
+         std::chrono::duration<double>(clock_type::now() - start).count();
+   drain(_sink, _filtered ? before : before + size_t(_threads) * _calls);
+
+   std::vector<long long> all;
+   all.reserve(size_t(_threads) * _calls);
+   for (const auto &l : latencies) {
+      all.insert(all.end(), l.begin(), l.end());
+   }
+   std::sort(all.begin(), all.end());
+   const auto percentile = [&all](double _p) {
+      return all.at(size_t(_p * double(all.size() - 1U)));
+   };
+   std::fprintf(s_results,
+         "{\"bench\": \"producer\", \"macro\": \"%s\", "
+         "\"filtered\": %s, \"threads\": %u, \"calls\": %zu, "
+         "\"p50_ns\": %lld, \"p99_ns\": %lld, \"p999_ns\": %lld, "
+         "\"max_ns\": %lld, \"calls_per_s\": %.0f}\n",
+         macro_name(_m), _filtered ? "true" : "false", _threads, all.size(),
+         percentile(0.5), percentile(0.99), percentile(0.999), all.back(),
+         double(all.size()) / seconds);
+   std::fflush(s_results);
+}
+
+void throughput(const char *_name, SuS::logfile::output_stream *_sink,
+      unsigned _messages) {
+   const auto logger = SuS::logfile::logger::instance();
+   logger->add_output_stream(_sink, "bench");
+   const auto before = _sink->written();
+   const auto start = clock_type::now();
+   for (unsigned i = 0U; i < _messages; ++i) {
+      SuS_LOG_STREAM(info, log_id(), "benchmark message " << i);
+   }
+   const auto logged = clock_type::now();
+   drain(_sink, before + _messages);
+   const auto done = clock_type::now();
+   logger->remove_output_stream("bench");
+
+   const auto seconds = std::chrono::duration<double>(done - start).count();
+   std::fprintf(s_results,
+         "{\"bench\": \"throughput\", \"sink\": \"%s\", "
+         "\"messages\": %u, \"logging_s\": %.6f, \"delivery_s\": %.6f, "
+         "\"messages_per_s\": %.0f}\n",
+         _name, _messages,
+         std::chrono::duration<double>(logged - start).count(), seconds,
+         double(_messages) / seconds);
+   std::fflush(s_results);
+}
+
+//! Remove the files in _dir, and _dir itself.
+void remove_dir(const std::string &_dir) {
+   if (const auto d = ::opendir(_dir.c_str())) {
+      while (const auto e = ::readdir(d)) {
+         const std::string name{e->d_name};
+         if ((name != ".") && (name != "..")) {
+            std::remove((_dir + "/" + name).c_str());
+         }
+      }
+      ::closedir(d);
+   }
+   ::rmdir(_dir.c_str());
+}
+
+void usage(const char *_argv0) {
+   std::cerr << "usage: " << _argv0 << " [options]" << std::endl
+             << "  -t <n>     up to n producer threads (default: 64)"
+             << std::endl
+             << "  -n <n>     calls per producer thread (default: 10000)"
+             << std::endl
+             << "  -m <n>     messages per throughput run (default: 200000)"
+             << std::endl
+             << "  -d <dir>   directory for the file sink (default: a new "
+                "one in /tmp)"
+             << std::endl
+             << "  -o <path>  file for the results (default: stdout)"
+             << std::endl;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+   unsigned max_threads = 64U;
+   unsigned calls = 10000U;
+   unsigned messages = 200000U;
+   std::string dir;
+   std::string results;
+   int opt;
+   while ((opt = ::getopt(argc, argv, "t:n:m:d:o:")) != -1) {
+      switch (opt) {
+      case 't':
+         max_threads = unsigned(std::atoi(optarg));
+         break;
+      case 'n':
+         calls = unsigned(std::atoi(optarg));
+         break;
+      case 'm':
+         messages = unsigned(std::atoi(optarg));
+         break;
+      case 'd':
+         dir = optarg;
+         break;
+      case 'o':
+         results = optarg;
+         break;
+      default:
+         usage(argv[0]);
+         return 2;
+      }
+   }
+   if (!max_threads || !calls || !messages) {
+      usage(argv[0]);
+      return 2;
+   }
+
+   s_results = results.empty() ? stdout : std::fopen(results.c_str(), "w");
+   if (!s_results) {
+      std::perror(results.c_str());
+      return 1;
+   }
+
+   const auto logger = SuS::logfile::logger::instance();
+   // the results may go to stdout.
+   logger->remove_output_stream("stdout");
+   log_id.set_min_log_level(SuS::logfile::logger::log_level::info);
+
+   const auto sink = new SuS::logfile::output_stream_null;
+   logger->add_output_stream(sink, "null");
+   for (const auto m :
+         {macro_type::log, macro_type::stream, macro_type::printf}) {
+      for (const auto filtered : {true, false}) {
+         for (unsigned threads = 1U; threads <= max_threads; threads *= 2U) {
+            producer(sink, m, filtered, threads, calls);
+         }
+      }
+   }
+   logger->remove_output_stream("null");
+
+   null_buffer buffer;
+   std::ostream discard(&buffer);
+   throughput("null", new SuS::logfile::output_stream_null, messages);
+   throughput("capture", new SuS::logfile::output_stream_capture, messages);
+   throughput("stdout",
+         new SuS::logfile::output_stream_stdout("stdout", discard), messages);
+   // the file sink renames its file when it is closed => let it write into
+   // a directory of its own.
+   auto remove = false;
+   if (dir.empty()) {
+      char tmp[] = "/tmp/logfile-bench-XXXXXX";
+      if (!::mkdtemp(tmp)) {
+         std::perror("mkdtemp");
+         return 1;
+      }
+      dir = tmp;
+      remove = true;
+   }
+   // large enough not to be rotated during the run.
+   throughput("file",
+         new SuS::logfile::output_stream_file(dir + "/bench.log",
+               std::streampos(1024) * 1024 * 1024 * 1024),
+         messages);
+   if (remove) {
+      remove_dir(dir);
+   }
+   if (s_results != stdout) {
+      std::fclose(s_results);
+   }
+   return 0;
+}
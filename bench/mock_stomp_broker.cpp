@@ -0,0 +1,300 @@
+/* SPDX-License-Identifier: MIT */
+#include "mock_stomp_broker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <stdexcept>
+#include <string.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace {
+typedef std::chrono::steady_clock clock_type;
+
+//! How often the loops look at the stop flag.
+const int s_poll_ms = 100;
+
+std::string system_error(const std::string &_what) {
+   return _what + ": " + ::strerror(errno);
+}
+
+//! Get a header from a frame, or "" if it is missing.
+std::string header(
+      const SuS::logfile::stomp_frame &_frame, const std::string &_key) {
+   const auto i = _frame.headers.find(_key);
+   return (i == _frame.headers.end()) ? std::string{} : i->second;
+}
+} // namespace
+
+struct SuS::logfile::mock_stomp_broker::connection {
+   int fd;
+   //! Period of our heart-beats after CONNECT. 0: none.
+   clock_type::duration heartbeat{0};
+   clock_type::time_point next_heartbeat;
+};
+
+SuS::logfile::mock_stomp_broker::mock_stomp_broker(
+      const options &_options, send_hook_t _hook)
+   : m_options(_options), m_hook(std::move(_hook)) {
+   if (m_options.unix_path.empty()) {
+      m_listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+      if (m_listen_fd < 0) {
+         throw std::runtime_error{system_error("socket")};
+      }
+      const int one = 1;
+      ::setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+      ::sockaddr_in addr;
+      ::memset(&addr, 0, sizeof addr);
+      addr.sin_family = AF_INET;
+      addr.sin_port = htons(m_options.port);
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      if (::bind(m_listen_fd, reinterpret_cast<const ::sockaddr *>(&addr),
+                sizeof addr) != 0) {
+         const auto error = system_error("bind");
+         ::close(m_listen_fd);
+         throw std::runtime_error{error};
+      }
+      ::socklen_t len = sizeof addr;
+      ::getsockname(
+            m_listen_fd, reinterpret_cast<::sockaddr *>(&addr), &len);
+      m_port = ntohs(addr.sin_port);
+   } else {
+      ::sockaddr_un addr;
+      if (m_options.unix_path.size() >= sizeof addr.sun_path) {
+         throw std::invalid_argument{
+               "Socket path too long: " + m_options.unix_path};
+      }
+      m_listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+      if (m_listen_fd < 0) {
+         throw std::runtime_error{system_error("socket")};
+      }
+      ::memset(&addr, 0, sizeof addr);
+      addr.sun_family = AF_UNIX;
+      ::strcpy(addr.sun_path, m_options.unix_path.c_str());
+      // a left-over socket file from an earlier run.
+      ::unlink(addr.sun_path);
+      if (::bind(m_listen_fd, reinterpret_cast<const ::sockaddr *>(&addr),
+                sizeof addr) != 0) {
+         const auto error = system_error("bind");
+         ::close(m_listen_fd);
+         throw std::runtime_error{error};
+      }
+   }
+   if (::listen(m_listen_fd, 16) != 0) {
+      const auto error = system_error("listen");
+      ::close(m_listen_fd);
+      throw std::runtime_error{error};
+   }
+   m_accept_thread = std::thread(&mock_stomp_broker::accept_loop, this);
+} // mock_stomp_broker constructor
+
+SuS::logfile::mock_stomp_broker::~mock_stomp_broker() {
+   stop();
+} // mock_stomp_broker destructor
+
+uint16_t SuS::logfile::mock_stomp_broker::port() const {
+   return m_port;
+} // mock_stomp_broker::port
+
+SuS::logfile::mock_stomp_broker::stats
+SuS::logfile::mock_stomp_broker::get_stats() const {
+   stats ret;
+   ret.connections = m_connections;
+   ret.sends = m_sends;
+   ret.receipts = m_receipts;
+   ret.errors = m_errors;
+   ret.drops = m_drops;
+   ret.heartbeats = m_heartbeats;
+   return ret;
+} // mock_stomp_broker::get_stats
+
+void SuS::logfile::mock_stomp_broker::stop() {
+   if (m_stop.exchange(true)) {
+      return;
+   }
+   m_accept_thread.join();
+   ::close(m_listen_fd);
+   if (!m_options.unix_path.empty()) {
+      ::unlink(m_options.unix_path.c_str());
+   }
+   std::vector<std::thread> threads;
+   {
+      std::lock_guard<std::mutex> lk(m_mutex);
+      // wake up the threads blocked in send().
+      for (const auto fd : m_fds) {
+         ::shutdown(fd, SHUT_RDWR);
+      }
+      threads.swap(m_threads);
+   }
+   for (auto &t : threads) {
+      t.join();
+   }
+} // mock_stomp_broker::stop
+
+void SuS::logfile::mock_stomp_broker::accept_loop() {
+   while (!m_stop) {
+      ::pollfd p{m_listen_fd, POLLIN, 0};
+      if (::poll(&p, 1, s_poll_ms) <= 0) {
+         continue;
+      }
+      const auto fd = ::accept(m_listen_fd, nullptr, nullptr);
+      if (fd < 0) {
+         continue;
+      }
+      ++m_connections;
+      std::lock_guard<std::mutex> lk(m_mutex);
+      m_fds.insert(fd);
+      m_threads.emplace_back(&mock_stomp_broker::serve, this, fd);
+   }
+} // mock_stomp_broker::accept_loop
+
+void SuS::logfile::mock_stomp_broker::serve(int _fd) {
+   connection c;
+   c.fd = _fd;
+   auto open = true;
+   stomp_frame_parser parser{[&](const stomp_frame &_frame) {
+      open = handle(c, _frame);
+      return open;
+   }};
+
+   while (open && !m_stop) {
+      auto timeout = s_poll_ms;
+      const auto now = clock_type::now();
+      if (c.heartbeat.count()) {
+         if (now >= c.next_heartbeat) {
+            if (!send_frame(c, "\n")) {
+               break;
+            }
+            ++m_heartbeats;
+            c.next_heartbeat = now + c.heartbeat;
+         }
+         const auto until_heartbeat =
+               std::chrono::duration_cast<std::chrono::milliseconds>(
+                     c.next_heartbeat - now)
+                     .count();
+         timeout = std::min(timeout, int(until_heartbeat) + 1);
+      }
+      ::pollfd p{_fd, POLLIN, 0};
+      const auto ready = ::poll(&p, 1, timeout);
+      if (ready < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         break;
+      }
+      if (ready == 0) {
+         continue;
+      }
+      // prepare() may grow the buffer => call it before space().
+      const auto buf = parser.prepare();
+      const auto n = ::recv(_fd, buf, parser.space(), 0);
+      if (n <= 0) {
+         break;
+      }
+      if (!parser.commit(size_t(n))) {
+         break;
+      }
+   }
+
+   std::lock_guard<std::mutex> lk(m_mutex);
+   m_fds.erase(_fd);
+   ::close(_fd);
+} // mock_stomp_broker::serve
+
+bool SuS::logfile::mock_stomp_broker::handle(
+      connection &_c, const stomp_frame &_frame) {
+   if ((_frame.command == "CONNECT") || (_frame.command == "STOMP")) {
+      std::string reply = "CONNECTED\nversion:" + m_options.version + "\n";
+      if (m_options.heartbeat_ms) {
+         const auto hb = std::to_string(m_options.heartbeat_ms);
+         reply += "heart-beat:" + hb + "," + hb + "\n";
+         // the client's wish: <it sends>,<it wants to receive>
+         const auto client_hb = header(_frame, "heart-beat");
+         const auto comma = client_hb.find(',');
+         const auto wanted = (comma == std::string::npos)
+               ? 0UL
+               : std::strtoul(client_hb.c_str() + comma + 1, nullptr, 10);
+         if (wanted && !m_options.silent) {
+            _c.heartbeat = std::chrono::milliseconds(
+                  std::max<unsigned long>(wanted, m_options.heartbeat_ms));
+            _c.next_heartbeat = clock_type::now() + _c.heartbeat;
+         }
+      }
+      reply += "server:mock_stomp_broker\n\n";
+      reply += '\0';
+      return send_frame(_c, reply);
+   }
+
+   if (_frame.command == "SEND") {
+      const auto n = ++m_sends;
+      if (m_hook) {
+         m_hook(_frame);
+      }
+      if (m_options.drop_every && (n % m_options.drop_every == 0U)) {
+         ++m_drops;
+         return false;
+      }
+      if (m_options.error_every && (n % m_options.error_every == 0U)) {
+         ++m_errors;
+         const std::string body = "Injected error.\n";
+         std::string reply = "ERROR\nmessage:injected error\n"
+                             "content-type:text/plain\ncontent-length:" +
+               std::to_string(body.size()) + "\n\n" + body;
+         reply += '\0';
+         send_frame(_c, reply);
+         // a broker closes the connection after an ERROR.
+         return false;
+      }
+   } else if (_frame.command != "DISCONNECT") {
+      // not needed by the sink => no need to support it.
+      return true;
+   }
+
+   const auto receipt = header(_frame, "receipt");
+   if (!receipt.empty()) {
+      if (m_options.receipt_delay_ms) {
+         std::this_thread::sleep_for(
+               std::chrono::milliseconds(m_options.receipt_delay_ms));
+      }
+      std::string reply = "RECEIPT\nreceipt-id:" + receipt + "\n\n";
+      reply += '\0';
+      if (!send_frame(_c, reply)) {
+         return false;
+      }
+      ++m_receipts;
+   }
+   return _frame.command != "DISCONNECT";
+} // mock_stomp_broker::handle
+
+bool SuS::logfile::mock_stomp_broker::send_frame(
+      connection &_c, const std::string &_frame) {
+   auto data = _frame.data();
+   auto left = _frame.size();
+   while (left) {
+      const auto n = ::send(_c.fd, data, left, MSG_NOSIGNAL);
+      if (n < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         return false;
+      }
+      data += n;
+      left -= size_t(n);
+   }
+   if (_c.heartbeat.count()) {
+      // every frame counts as a heart-beat.
+      _c.next_heartbeat = clock_type::now() + _c.heartbeat;
+   }
+   return true;
+} // mock_stomp_broker::send_frame
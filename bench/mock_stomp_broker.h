@@ -0,0 +1,121 @@
+/* SPDX-License-Identifier: MIT */
+/*! @file */
+#pragma once
+
+#include "stomp_frame_parser.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace SuS {
+namespace logfile {
+
+//! A minimal STOMP server for benchmarks and fault injection.
+/*!
+ * It speaks just enough STOMP for output_stream_stomp: CONNECT/STOMP is
+ * answered with CONNECTED, SEND with RECEIPT (if requested), DISCONNECT
+ * closes the connection. Messages are not routed anywhere, but can be
+ * inspected with a hook.
+ *
+ * Faults are injected by counting the SEND frames of all connections:
+ * every n-th SEND can be answered with an ERROR frame or make the broker
+ * drop the connection without an answer. Receipts can be delayed to
+ * simulate a slow or distant broker.
+ *
+ * Every connection is served by its own thread with blocking I/O, which
+ * is fine for the few connections of a test.
+ */
+class mock_stomp_broker {
+ public:
+   struct options {
+      //! TCP port to listen on (127.0.0.1). 0 picks a free port.
+      uint16_t port{0U};
+      //! Listen on this Unix domain socket instead of TCP, if not empty.
+      std::string unix_path;
+      //! Version reported in CONNECTED.
+      std::string version{"1.2"};
+      //! Wait this long before sending a RECEIPT.
+      unsigned receipt_delay_ms{0U};
+      //! Answer every n-th SEND with ERROR and close. 0 disables.
+      unsigned error_every{0U};
+      //! Close the connection on every n-th SEND without answering.
+      unsigned drop_every{0U};
+      //! Heart-beat period offered in both directions. 0 disables.
+      unsigned heartbeat_ms{0U};
+      //! Offer heart-beats, but never send any.
+      bool silent{false};
+   };
+
+   //! Counters since the start of the broker.
+   struct stats {
+      unsigned long connections{0U};
+      unsigned long sends{0U};
+      unsigned long receipts{0U};
+      unsigned long errors{0U};
+      unsigned long drops{0U};
+      unsigned long heartbeats{0U};
+   };
+
+   //! Called for every SEND frame, before it is answered.
+   /*!
+    * Called from the connection threads, possibly concurrently.
+    */
+   typedef std::function<void(const stomp_frame &)> send_hook_t;
+
+   //! Start listening and accepting connections.
+   /*!
+    * @throw std::runtime_error The socket could not be set up.
+    */
+   explicit mock_stomp_broker(const options &_options,
+         send_hook_t _hook = send_hook_t{});
+   mock_stomp_broker(const mock_stomp_broker &) = delete;
+   mock_stomp_broker &operator=(const mock_stomp_broker &) = delete;
+   ~mock_stomp_broker();
+
+   //! The TCP port actually listened on.
+   uint16_t port() const;
+
+   stats get_stats() const;
+
+   //! Close all connections and stop listening.
+   void stop();
+
+ private:
+   //! State of one client connection.
+   struct connection;
+
+   void accept_loop();
+   void serve(int _fd);
+   //! Answer a frame. False closes the connection.
+   bool handle(connection &_c, const stomp_frame &_frame);
+   bool send_frame(connection &_c, const std::string &_frame);
+
+   const options m_options;
+   const send_hook_t m_hook;
+   int m_listen_fd{-1};
+   uint16_t m_port{0U};
+   std::atomic<bool> m_stop{false};
+
+   std::atomic<unsigned long> m_connections{0U};
+   std::atomic<unsigned long> m_sends{0U};
+   std::atomic<unsigned long> m_receipts{0U};
+   std::atomic<unsigned long> m_errors{0U};
+   std::atomic<unsigned long> m_drops{0U};
+   std::atomic<unsigned long> m_heartbeats{0U};
+
+   //! Protects m_fds and m_threads.
+   std::mutex m_mutex;
+   //! Open client connections, to shut them down in stop().
+   std::set<int> m_fds;
+   std::vector<std::thread> m_threads;
+   std::thread m_accept_thread;
+}; // class mock_stomp_broker
+
+} // namespace logfile
+} // namespace SuS
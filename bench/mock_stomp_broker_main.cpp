@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: MIT */
+// Stand-alone mock STOMP broker, e.g. for trying out the STOMP sink of an
+// application without an ActiveMQ at hand:
+//
+//   mock-stomp-broker -p 61613 -l 5 -d 1000
+//
+// accepts connections on 127.0.0.1:61613, delays every receipt by 5 ms
+// and drops the connection on every 1000th message. The counters are
+// printed every second while they change. Stop it with Ctrl-C.
+#include "mock_stomp_broker.h"
+
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#include <unistd.h>
+
+namespace {
+volatile std::sig_atomic_t s_terminate = 0;
+
+void on_signal(int) {
+   s_terminate = 1;
+}
+
+void usage(const char *_argv0) {
+   std::cerr
+         << "usage: " << _argv0 << " [options]" << std::endl
+         << "  -p <port>   TCP port on 127.0.0.1 (default: 61613)" << std::endl
+         << "  -u <path>   listen on a Unix domain socket instead" << std::endl
+         << "  -v <ver>    version reported in CONNECTED (default: 1.2)"
+         << std::endl
+         << "  -l <ms>     delay of every RECEIPT" << std::endl
+         << "  -e <n>      answer every n-th SEND with ERROR" << std::endl
+         << "  -d <n>      drop the connection on every n-th SEND" << std::endl
+         << "  -b <ms>     offer heart-beats with this period" << std::endl
+         << "  -s          offer heart-beats, but do not send them"
+         << std::endl
+         << "  -q          only print the final counters" << std::endl;
+}
+
+std::ostream &operator<<(std::ostream &_stream,
+      const SuS::logfile::mock_stomp_broker::stats &_s) {
+   return _stream << "connections: " << _s.connections
+                  << ", sends: " << _s.sends << ", receipts: " << _s.receipts
+                  << ", errors: " << _s.errors << ", drops: " << _s.drops
+                  << ", heart-beats: " << _s.heartbeats;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+   SuS::logfile::mock_stomp_broker::options options;
+   options.port = 61613U;
+   auto quiet = false;
+   int opt;
+   while ((opt = ::getopt(argc, argv, "p:u:v:l:e:d:b:sq")) != -1) {
+      switch (opt) {
+      case 'p':
+         options.port = uint16_t(std::atoi(optarg));
+         break;
+      case 'u':
+         options.unix_path = optarg;
+         break;
+      case 'v':
+         options.version = optarg;
+         break;
+      case 'l':
+         options.receipt_delay_ms = unsigned(std::atoi(optarg));
+         break;
+      case 'e':
+         options.error_every = unsigned(std::atoi(optarg));
+         break;
+      case 'd':
+         options.drop_every = unsigned(std::atoi(optarg));
+         break;
+      case 'b':
+         options.heartbeat_ms = unsigned(std::atoi(optarg));
+         break;
+      case 's':
+         options.silent = true;
+         break;
+      case 'q':
+         quiet = true;
+         break;
+      default:
+         usage(argv[0]);
+         return 2;
+      }
+   }
+
+   std::signal(SIGINT, on_signal);
+   std::signal(SIGTERM, on_signal);
+   std::signal(SIGPIPE, SIG_IGN);
+
+   try {
+      SuS::logfile::mock_stomp_broker broker{options};
+      if (options.unix_path.empty()) {
+         std::cout << "listening on 127.0.0.1:" << broker.port() << std::endl;
+      } else {
+         std::cout << "listening on " << options.unix_path << std::endl;
+      }
+
+      unsigned long last_sends = 0U, last_connections = 0U;
+      while (!s_terminate) {
+         std::this_thread::sleep_for(std::chrono::seconds(1));
+         const auto s = broker.get_stats();
+         if (!quiet && ((s.sends != last_sends) ||
+                             (s.connections != last_connections))) {
+            std::cout << s << std::endl;
+            last_sends = s.sends;
+            last_connections = s.connections;
+         }
+      }
+      broker.stop();
+      std::cout << broker.get_stats() << std::endl;
+   } catch (const std::exception &e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,85 @@
+/* SPDX-License-Identifier: MIT */
+// Throughput of the STOMP reply parser.
+//
+// A stream of RECEIPT frames with interspersed heart-beats and an occasional
+// ERROR frame (with content-length) is fed to the parser in chunks of varying
+// size, mimicking what the net_reactor sees with pipelined sends.
+#include "stomp_frame_parser.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string.h>
+#include <string>
+
+namespace {
+std::string make_stream(unsigned _frames) {
+   std::string ret;
+   for (unsigned i = 1U; i <= _frames; ++i) {
+      if (i % 1000U == 0U) {
+         ret += "ERROR\nmessage:something went wrong\ncontent-type:text/"
+                "plain\ncontent-length:23\n\nThe body of the error.\n";
+         ret += '\0';
+      } else {
+         ret += "RECEIPT\nreceipt-id:" + std::to_string(i) + "\n\n";
+         ret += '\0';
+      }
+      if (i % 10U == 0U) {
+         // heart-beat
+         ret += '\n';
+      }
+   }
+   return ret;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+   const auto frames = (argc > 1) ? unsigned(::atoi(argv[1])) : 100000U;
+   const auto rounds = (argc > 2) ? unsigned(::atoi(argv[2])) : 50U;
+   const auto stream = make_stream(frames);
+
+   unsigned long receipts = 0U;
+   unsigned long others = 0U;
+   SuS::logfile::stomp_frame_parser parser{
+         [&](const SuS::logfile::stomp_frame &_f) {
+            if (_f.has_receipt_id) {
+               ++receipts;
+            } else {
+               ++others;
+            }
+            return true;
+         }};
+
+   // chunk sizes cycle through these to split frames at random places.
+   const size_t chunks[] = {1536U, 7U, 16384U, 333U, 4096U, 1U, 9000U};
+   const auto start = std::chrono::steady_clock::now();
+   for (unsigned r = 0U; r < rounds; ++r) {
+      size_t pos = 0U;
+      unsigned c = 0U;
+      while (pos < stream.size()) {
+         const auto dst = parser.prepare();
+         auto n = std::min(chunks[c++ % (sizeof chunks / sizeof chunks[0])],
+               parser.space());
+         n = std::min(n, stream.size() - pos);
+         ::memcpy(dst, stream.data() + pos, n);
+         if (!parser.commit(n)) {
+            std::cerr << "parse error" << std::endl;
+            return 1;
+         }
+         pos += n;
+      }
+   }
+   const auto elapsed = std::chrono::duration<double>(
+         std::chrono::steady_clock::now() - start)
+                              .count();
+
+   const auto total_frames = double(receipts + others);
+   const auto total_bytes = double(stream.size()) * rounds;
+   std::cout << "frames:      " << receipts + others << " (" << receipts
+             << " receipts)" << std::endl
+             << "time:        " << elapsed << " s" << std::endl
+             << "frames/s:    " << total_frames / elapsed << std::endl
+             << "MB/s:        " << total_bytes / elapsed / 1e6 << std::endl;
+   return 0;
+}
@@ -0,0 +1,227 @@
+/* SPDX-License-Identifier: MIT */
+// Throughput and latency of the STOMP sink against the in-process mock
+// broker, without any network access.
+//
+// Every message carries its number and the time it was logged. The run
+// ends when the broker has seen every message at least once, or when
+// nothing arrived for 30 s (lost fire-and-forget messages). Injected
+// drops and errors make the sink go through its retry path, which shows up
+// in the latency tail and as duplicates (messages that were delivered, but
+// whose receipt got lost).
+//
+//   stomp-sink-bench -n 20000             plain throughput
+//   stomp-sink-bench -n 2000 -l 1         1 ms broker latency per receipt
+//   stomp-sink-bench -n 20000 -d 5000     retry path: drop every 5000th
+//   stomp-sink-bench -n 20000 -r warning  fire-and-forget below warning
+#include "logger.h"
+#include "mock_stomp_broker.h"
+#include "output_stream_stomp.h"
+#include "subsystem_registrator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+SuS::logfile::subsystem_registrator log_id{"bench"};
+
+typedef std::chrono::steady_clock clock_type;
+
+const char s_marker[] = "<string>bench ";
+
+long long now_us() {
+   return std::chrono::duration_cast<std::chrono::microseconds>(
+         clock_type::now().time_since_epoch())
+         .count();
+}
+
+//! Collects what arrives at the broker.
+struct collector {
+   explicit collector(unsigned _messages)
+      : seen(_messages, false), latency_us(_messages, 0) {
+   }
+
+   void on_send(const SuS::logfile::stomp_frame &_frame) {
+      // the TEXT entry of the XML map: "bench <number> <time>"
+      const auto p = _frame.body.find(s_marker);
+      if (p == std::string::npos) {
+         // a message of the library itself.
+         return;
+      }
+      char *end;
+      const auto number = std::strtoul(
+            _frame.body.c_str() + p + sizeof s_marker - 1, &end, 10);
+      const auto logged = std::strtoll(end, nullptr, 10);
+      const auto arrived = now_us();
+      std::lock_guard<std::mutex> lk(mutex);
+      if (number >= seen.size()) {
+         return;
+      }
+      if (seen[number]) {
+         ++duplicates;
+         return;
+      }
+      seen[number] = true;
+      latency_us[number] = arrived - logged;
+      last_arrival = clock_type::now();
+      ++received;
+      cv.notify_all();
+   }
+
+   std::mutex mutex;
+   std::condition_variable cv;
+   std::vector<bool> seen;
+   std::vector<long long> latency_us;
+   unsigned long received{0U};
+   unsigned long duplicates{0U};
+   clock_type::time_point last_arrival;
+};
+
+void usage(const char *_argv0) {
+   std::cerr << "usage: " << _argv0 << " [options]" << std::endl
+             << "  -n <count>  messages to log (default: 20000)" << std::endl
+             << "  -l <ms>     delay of every RECEIPT" << std::endl
+             << "  -e <n>      answer every n-th SEND with ERROR" << std::endl
+             << "  -d <n>      drop the connection on every n-th SEND"
+             << std::endl
+             << "  -r <level>  request receipts only from this level on"
+             << std::endl
+             << "  -c          send content-length" << std::endl;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+   unsigned messages = 20000U;
+   SuS::logfile::mock_stomp_broker::options options;
+   auto receipt_level = SuS::logfile::logger::log_level::finest;
+   auto content_length = false;
+   int opt;
+   while ((opt = ::getopt(argc, argv, "n:l:e:d:r:c")) != -1) {
+      switch (opt) {
+      case 'n':
+         messages = unsigned(std::atoi(optarg));
+         break;
+      case 'l':
+         options.receipt_delay_ms = unsigned(std::atoi(optarg));
+         break;
+      case 'e':
+         options.error_every = unsigned(std::atoi(optarg));
+         break;
+      case 'd':
+         options.drop_every = unsigned(std::atoi(optarg));
+         break;
+      case 'r':
+         receipt_level = SuS::logfile::logger::level_by_name(optarg);
+         break;
+      case 'c':
+         content_length = true;
+         break;
+      default:
+         usage(argv[0]);
+         return 2;
+      }
+   }
+   if (!messages) {
+      usage(argv[0]);
+      return 2;
+   }
+
+   // message 0 is sent before the measurement, so that the connection
+   // is set up.
+   // never deleted: the sink delivers what is left from an atexit handler,
+   // so the broker has to outlive main.
+   const auto c = new collector{messages + 1U};
+   const auto broker = new SuS::logfile::mock_stomp_broker{options,
+         [c](const SuS::logfile::stomp_frame &_f) { c->on_send(_f); }};
+
+   const auto logger = SuS::logfile::logger::instance();
+   // only measure the STOMP sink.
+   logger->remove_output_stream("stdout");
+   const auto sink = new SuS::logfile::output_stream_stomp(
+         "bench", "stomp://127.0.0.1:" + std::to_string(broker->port()) +
+                     "/BENCH");
+   sink->set_receipt_min_level(receipt_level);
+   sink->set_content_length(content_length);
+   sink->set_min_log_level(SuS::logfile::logger::log_level::info);
+   logger->add_output_stream(sink, "stomp");
+
+   // waits until _received messages arrived, or nothing arrived for a
+   // while. fire-and-forget messages can get lost.
+   const auto wait_for = [c](unsigned long _received) {
+      std::unique_lock<std::mutex> lk(c->mutex);
+      while (c->received < _received) {
+         const auto before = c->received;
+         if (!c->cv.wait_for(lk, std::chrono::seconds(30),
+                   [&]() { return c->received != before; })) {
+            break;
+         }
+      }
+      return c->received;
+   };
+
+   const auto connect_start = clock_type::now();
+   // severe is always acknowledged => retried until the connection is up.
+   SuS_LOG_STREAM(severe, log_id(), "bench 0 " << now_us());
+   if (!wait_for(1U)) {
+      std::cerr << "could not connect to the broker." << std::endl;
+      return 1;
+   }
+   const auto start = clock_type::now();
+   for (unsigned i = 1U; i <= messages; ++i) {
+      SuS_LOG_STREAM(info, log_id(), "bench " << i << ' ' << now_us());
+   }
+   const auto logged = clock_type::now();
+   const auto lost = messages + 1U - wait_for(messages + 1U);
+
+   std::vector<long long> latencies;
+   unsigned long duplicates;
+   clock_type::time_point done;
+   {
+      std::lock_guard<std::mutex> lk(c->mutex);
+      done = c->last_arrival;
+      for (size_t i = 1U; i < c->seen.size(); ++i) {
+         if (c->seen[i]) {
+            latencies.push_back(c->latency_us[i]);
+         }
+      }
+      duplicates = c->duplicates;
+   }
+   if (latencies.empty()) {
+      std::cerr << "no message arrived." << std::endl;
+      return 1;
+   }
+
+   std::sort(latencies.begin(), latencies.end());
+   const auto percentile = [&latencies](double _p) {
+      return latencies.at(size_t(_p * double(latencies.size() - 1U)));
+   };
+   const auto seconds = [](clock_type::duration _d) {
+      return std::chrono::duration<double>(_d).count();
+   };
+   const auto s = broker->get_stats();
+   std::cout << "connect:     " << seconds(start - connect_start) << " s"
+             << std::endl
+             << "messages:    " << messages << " (" << duplicates
+             << " duplicates, " << lost << " lost)" << std::endl
+             << "logging:     " << seconds(logged - start) << " s"
+             << std::endl
+             << "delivery:    " << seconds(done - start) << " s, "
+             << (messages - lost) / seconds(done - start) << " messages/s"
+             << std::endl
+             << "latency:     p50 " << percentile(0.5) << " us, p99 "
+             << percentile(0.99) << " us, max " << latencies.back() << " us"
+             << std::endl
+             << "broker:      " << s.connections << " connections, "
+             << s.receipts << " receipts, " << s.errors << " errors, "
+             << s.drops << " drops" << std::endl;
+   return 0;
+}
@@ -0,0 +1,347 @@
+/* SPDX-License-Identifier: MIT */
+// sigaltstack and SA_ONSTACK are XSI, not covered by _POSIX_C_SOURCE.
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 700
+#endif
+
+#include "crash_log.h"
+
+#include "config.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <signal.h>
+#include <stdexcept>
+#include <string.h>
+
+#ifdef HAVE_BACKTRACE_SYMBOLS
+#include <execinfo.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+const size_t SuS::logfile::crash_log::s_slots;
+const size_t SuS::logfile::crash_log::s_text_size;
+const size_t SuS::logfile::crash_log::s_max_fds;
+
+namespace {
+// everything here is zero- or constant-initialized: a crash can happen
+// before the dynamic initialization of this file, or after its static
+// objects have been destroyed.
+
+struct slot {
+   //! 0 while being written, otherwise the number of the event + 1.
+   std::atomic<unsigned long long> seq;
+   //! Microseconds since the epoch.
+   long long time;
+   unsigned char level;
+   unsigned short length;
+   char text[SuS::logfile::crash_log::s_text_size];
+};
+
+slot s_ring[SuS::logfile::crash_log::s_slots];
+//! Number of the next event.
+std::atomic<unsigned long long> s_next{0U};
+
+std::atomic<int> s_fds[SuS::logfile::crash_log::s_max_fds];
+std::atomic<size_t> s_fd_count{0U};
+//! Until set_fds() is called, the report goes to stderr.
+std::atomic<bool> s_fds_set{false};
+//! record() fills the ring. Turned on by set_fds().
+std::atomic<bool> s_recording{false};
+
+std::atomic<bool> s_crashing{false};
+
+// indexed by log level.
+const char *const s_level_names[] = {
+      "finest", "finer", "fine", "config", "info", "warning", "severe"};
+
+#if defined HAVE_SIGACTION && defined HAVE_UNISTD_H
+const int s_signals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+const char *const s_signal_names[] = {
+      "SIGSEGV", "SIGBUS", "SIGFPE", "SIGILL", "SIGABRT"};
+const size_t s_signal_count = sizeof s_signals / sizeof s_signals[0];
+struct ::sigaction s_old_actions[s_signal_count];
+//! The thread writing the report.
+::pthread_t s_reporter;
+std::atomic<bool> s_reporter_set{false};
+//! How long other crashing threads wait for the report, in 100 ms.
+const unsigned s_wait_steps = 50U;
+
+//! Index of _signal in s_signals. s_signal_count, if it is not there.
+size_t signal_index(int _signal) {
+   size_t ret = 0U;
+   while ((ret < s_signal_count) && (s_signals[ret] != _signal)) {
+      ++ret;
+   }
+   return ret;
+}
+
+// the helpers below only use async-signal-safe functions.
+
+void write_all(int _fd, const char *_data, size_t _len) {
+   while (_len) {
+      const auto n = ::write(_fd, _data, _len);
+      if (n < 0 && errno == EINTR) {
+         continue;
+      }
+      if (n <= 0) {
+         // nothing we can do about it.
+         return;
+      }
+      _data += n;
+      _len -= size_t(n);
+   }
+}
+
+void write_fds(const char *_data, size_t _len) {
+   if (!s_fds_set.load(std::memory_order_acquire)) {
+      write_all(STDERR_FILENO, _data, _len);
+      return;
+   }
+   const auto count = s_fd_count.load(std::memory_order_acquire);
+   for (size_t i = 0U; i < count; ++i) {
+      write_all(s_fds[i].load(std::memory_order_relaxed), _data, _len);
+   }
+}
+
+void write_fds(const char *_s) {
+   write_fds(_s, ::strlen(_s));
+}
+
+//! Append _s to the buffer at _p, up to _end.
+char *append(char *_p, const char *_end, const char *_s, size_t _len) {
+   _len = std::min(_len, size_t(_end - _p));
+   ::memcpy(_p, _s, _len);
+   return _p + _len;
+}
+
+char *append(char *_p, const char *_end, const char *_s) {
+   return append(_p, _end, _s, ::strlen(_s));
+}
+
+//! Append _v in decimal, with at least _digits digits.
+char *append(char *_p, const char *_end, unsigned long long _v,
+      unsigned _digits = 1U) {
+   char digits[24];
+   auto d = digits + sizeof digits;
+   do {
+      *--d = char('0' + _v % 10U);
+      _v /= 10U;
+   } while (_v || (digits + sizeof digits - d < _digits));
+   return append(_p, _end, d, size_t(digits + sizeof digits - d));
+}
+
+void write_events() {
+   const auto end = s_next.load(std::memory_order_acquire);
+   const auto begin = end > SuS::logfile::crash_log::s_slots
+         ? end - SuS::logfile::crash_log::s_slots
+         : 0U;
+   char line[64U + SuS::logfile::crash_log::s_text_size];
+   // leave room for the newline.
+   const auto line_end = line + sizeof line - 1U;
+   for (auto n = begin; n < end; ++n) {
+      const auto &s = s_ring[n % SuS::logfile::crash_log::s_slots];
+      if (s.seq.load(std::memory_order_acquire) != n + 1U) {
+         // being written, or already overwritten.
+         continue;
+      }
+      const auto time = std::max(s.time, 0LL);
+      const auto level = std::min<size_t>(
+            s.level, sizeof s_level_names / sizeof s_level_names[0] - 1U);
+      auto p = append(line, line_end, (unsigned long long)(time) / 1000000U);
+      p = append(p, line_end, ".");
+      p = append(p, line_end, (unsigned long long)(time) % 1000000U, 6U);
+      p = append(p, line_end, " ");
+      p = append(p, line_end, s_level_names[level]);
+      p = append(p, line_end, " ");
+      p = append(p, line_end, s.text,
+            std::min<size_t>(s.length, SuS::logfile::crash_log::s_text_size));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (s.seq.load(std::memory_order_relaxed) != n + 1U) {
+         // overwritten while we copied it.
+         continue;
+      }
+      *p++ = '\n';
+      write_fds(line, size_t(p - line));
+   }
+}
+#endif
+} // namespace
+
+void SuS::logfile::crash_log::record(logger::log_level _level,
+      const std::string &_subsystem, const std::string &_message,
+      std::chrono::system_clock::time_point _time) {
+   if (!s_recording.load(std::memory_order_relaxed)) {
+      return;
+   }
+   const auto n = s_next.fetch_add(1U, std::memory_order_relaxed);
+   auto &s = s_ring[n % s_slots];
+   s.seq.store(0U, std::memory_order_relaxed);
+   std::atomic_thread_fence(std::memory_order_release);
+   s.time = std::chrono::duration_cast<std::chrono::microseconds>(
+         _time.time_since_epoch())
+                  .count();
+   s.level = static_cast<unsigned char>(_level);
+   auto len = std::min(_subsystem.size(), s_text_size);
+   ::memcpy(s.text, _subsystem.data(), len);
+   const auto sep = std::min(s_text_size - len, size_t(2U));
+   ::memcpy(s.text + len, ": ", sep);
+   len += sep;
+   const auto message = std::min(_message.size(), s_text_size - len);
+   ::memcpy(s.text + len, _message.data(), message);
+   // newlines would break up the report.
+   std::replace(s.text + len, s.text + len + message, '\n', ' ');
+   s.length = static_cast<unsigned short>(len + message);
+   s.seq.store(n + 1U, std::memory_order_release);
+} // crash_log::record
+
+void SuS::logfile::crash_log::set_fds(const std::vector<int> &_fds) {
+   if (_fds.size() > s_max_fds) {
+      throw std::invalid_argument{"Too many crash file descriptors."};
+   }
+   s_fd_count.store(0U, std::memory_order_release);
+   for (size_t i = 0U; i < _fds.size(); ++i) {
+      s_fds[i].store(_fds[i], std::memory_order_relaxed);
+   }
+   s_fd_count.store(_fds.size(), std::memory_order_release);
+   s_fds_set.store(true, std::memory_order_release);
+   s_recording.store(!_fds.empty(), std::memory_order_relaxed);
+} // crash_log::set_fds
+
+#if defined HAVE_SIGACTION && defined HAVE_UNISTD_H
+void SuS::logfile::crash_log::install() {
+   static std::atomic<bool> installed{false};
+   if (installed.exchange(true)) {
+      return;
+   }
+#ifdef HAVE_BACKTRACE_SYMBOLS
+   // the first call loads libgcc, which allocates. do that now rather than
+   // in the signal handler.
+   void *bt[1];
+   ::backtrace(bt, 1);
+#endif
+   install_signal_stack();
+
+   struct ::sigaction sa;
+   ::memset(&sa, 0, sizeof sa);
+   sa.sa_handler = handler;
+   sigemptyset(&sa.sa_mask);
+   sa.sa_flags = SA_RESTART;
+#ifdef HAVE_SIGALTSTACK
+   sa.sa_flags |= SA_ONSTACK;
+#endif
+   for (size_t i = 0U; i < s_signal_count; ++i) {
+      ::sigaction(s_signals[i], &sa, &s_old_actions[i]);
+   }
+} // crash_log::install
+
+void SuS::logfile::crash_log::install_signal_stack() {
+#ifdef HAVE_SIGALTSTACK
+   stack_t ss;
+   if ((::sigaltstack(nullptr, &ss) == 0) && !(ss.ss_flags & SS_DISABLE)) {
+      // the thread has one already.
+      return;
+   }
+   const auto size = std::max<size_t>(SIGSTKSZ, 64U * 1024U);
+   // never freed: the thread may crash until it ends.
+   ss.ss_sp = new char[size];
+   ss.ss_size = size;
+   ss.ss_flags = 0;
+   ::sigaltstack(&ss, nullptr);
+#endif
+} // crash_log::install_signal_stack
+
+void SuS::logfile::crash_log::handler(int _signal) {
+   const auto index = signal_index(_signal);
+   if (index == s_signal_count) {
+      ::signal(_signal, SIG_DFL);
+      ::raise(_signal);
+      return;
+   }
+   if (s_crashing.exchange(true)) {
+      if (!s_reporter_set.load(std::memory_order_acquire) ||
+            !::pthread_equal(s_reporter, ::pthread_self())) {
+         // another thread is reporting. it ends the process when it is
+         // done => do not cut its report short, but do not wait forever
+         // either.
+         const ::timespec step{0, 100L * 1000L * 1000L};
+         for (unsigned i = 0U; i < s_wait_steps; ++i) {
+            ::nanosleep(&step, nullptr);
+         }
+      }
+      // crashed while reporting, or the report did not end the process.
+      ::signal(_signal, SIG_DFL);
+      ::raise(_signal);
+      return;
+   }
+   s_reporter = ::pthread_self();
+   s_reporter_set.store(true, std::memory_order_release);
+
+   report(_signal);
+
+   // hand over to the previous handler. the signal is blocked until we
+   // return, so that it sees the raised one only then.
+   auto &old = s_old_actions[index];
+   if (!(old.sa_flags & SA_SIGINFO) && (old.sa_handler == SIG_IGN)) {
+      // would return to the faulting instruction forever.
+      old.sa_handler = SIG_DFL;
+   }
+   ::sigaction(_signal, &old, nullptr);
+   ::raise(_signal);
+} // crash_log::handler
+
+void SuS::logfile::crash_log::report(int _signal) {
+   char line[64];
+   const auto line_end = line + sizeof line;
+   auto p = append(line, line_end, "SIGNAL ");
+   p = append(p, line_end, (unsigned long long)(_signal));
+   p = append(p, line_end, " (");
+   p = append(p, line_end, s_signal_names[signal_index(_signal)]);
+   p = append(p, line_end, ") received\n");
+   write_fds(line, size_t(p - line));
+
+   write_fds("--- last events ---\n");
+   if (s_recording.load(std::memory_order_relaxed)) {
+      write_events();
+   } else {
+      write_fds("Not recorded, see logger::set_crash_fds().\n");
+   }
+
+   write_fds("--- backtrace ---\n");
+#ifdef HAVE_BACKTRACE_SYMBOLS
+   void *bt[64];
+   const auto bt_size = ::backtrace(bt, 64);
+   if (!s_fds_set.load(std::memory_order_acquire)) {
+      ::backtrace_symbols_fd(bt, bt_size, STDERR_FILENO);
+   } else {
+      const auto count = s_fd_count.load(std::memory_order_acquire);
+      for (size_t i = 0U; i < count; ++i) {
+         ::backtrace_symbols_fd(
+               bt, bt_size, s_fds[i].load(std::memory_order_relaxed));
+      }
+   }
+#else
+   write_fds("No backtrace available.\n");
+#endif
+} // crash_log::report
+
+#else
+void SuS::logfile::crash_log::install() {
+}
+
+void SuS::logfile::crash_log::install_signal_stack() {
+}
+
+void SuS::logfile::crash_log::handler(int) {
+}
+
+void SuS::logfile::crash_log::report(int) {
+}
+#endif
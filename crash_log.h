@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: MIT */
+/*! @file */
+#pragma once
+
+#include "logger.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace SuS {
+namespace logfile {
+
+//! What is written when the application crashes.
+/*!
+ * Once \ref set_fds has been called with at least one descriptor, every
+ * event submitted to the logger is also copied into a ring of \ref s_slots
+ * fixed-size slots in static memory, truncated to \ref s_text_size bytes.
+ * The copy is lock-free. Until then, \ref record does nothing, and the
+ * report has no events.
+ *
+ * When a fatal signal (SIGSEGV, SIGBUS, SIGFPE, SIGILL or SIGABRT) arrives,
+ * the handler writes the signal, the events in the ring and a backtrace to
+ * the crash file descriptors (stderr by default), using nothing but
+ * write(2). It neither allocates nor takes locks, and does not wait for
+ * the log thread or the sinks, so it finishes in bounded time even if the
+ * crash happened inside the logger. Then the previous handler of the
+ * signal is restored and the signal is raised again. Threads crashing
+ * while the report is written wait up to 5 s for it to end the process.
+ *
+ * The handler runs on an alternate signal stack, so that a stack overflow
+ * is reported as well. Signal stacks are per thread: \ref install sets one
+ * up for the calling thread, and the threads of the library set up their
+ * own. Other threads of the application have to call
+ * \ref install_signal_stack themselves.
+ */
+class crash_log {
+ public:
+   //! Install the signal handlers. Called once by the logger.
+   static void install();
+
+   //! Set up an alternate signal stack for the calling thread.
+   static void install_signal_stack();
+
+   //! Set the file descriptors the crash report is written to.
+   /*!
+    * Also turns the ring on, or off for an empty list.
+    * @throw std::invalid_argument More than \ref s_max_fds descriptors.
+    */
+   static void set_fds(const std::vector<int> &_fds);
+
+   //! Copy an event into the ring, if it is turned on.
+   static void record(logger::log_level _level, const std::string &_subsystem,
+         const std::string &_message,
+         std::chrono::system_clock::time_point _time);
+
+   //! Number of events kept in the ring.
+   static const size_t s_slots = 256U;
+   //! Bytes of "subsystem: message" kept per event.
+   static const size_t s_text_size = 240U;
+   static const size_t s_max_fds = 8U;
+
+ private:
+   static void handler(int _signal);
+   //! Write the report to all crash file descriptors.
+   static void report(int _signal);
+}; // class crash_log
+
+} // namespace logfile
+} // namespace SuS
@@ -0,0 +1,132 @@
+/* SPDX-License-Identifier: MIT */
+#include "dns_cache.h"
+#include "crash_log.h"
+#include "logger.h"
+#include "subsystem_registrator.h"
+
+#include <sstream>
+
+#include <stdexcept>
+#include <string.h>
+
+#if defined HAVE_GETADDRINFO || defined _WINDOWS
+namespace {
+SuS::logfile::subsystem_registrator log_id{"DNS"};
+} // namespace
+
+SuS::logfile::dns_cache *SuS::logfile::dns_cache::instance() {
+   // never deleted: sinks are destroyed from an atexit handler, which may
+   // run after static objects have been destroyed.
+   static dns_cache *s_instance = new dns_cache;
+   return s_instance;
+} // dns_cache::instance
+
+SuS::logfile::dns_cache::dns_cache() : m_thread(&dns_cache::run, this) {
+} // dns_cache constructor
+
+SuS::logfile::dns_cache::result_t SuS::logfile::dns_cache::resolve(
+      const std::string &_host, uint16_t _port) {
+   const auto key = key_t{_host, _port};
+   {
+      std::lock_guard<std::mutex> lk(m_mutex);
+      const auto i = m_entries.find(key);
+      if (i != m_entries.end()) {
+         auto &e = i->second;
+         if (clock::now() < e.expires) {
+            if (e.addresses) {
+               return e.addresses;
+            }
+            // negative caching: do not ask the resolver again yet.
+            throw std::runtime_error{e.error};
+         }
+         if (e.addresses) {
+            // expired: use the last known addresses now and refresh them
+            // in the background.
+            if (!e.refreshing) {
+               e.refreshing = true;
+               m_refresh_queue.push_back(key);
+               m_cv.notify_one();
+            }
+            return e.addresses;
+         }
+      }
+   }
+
+   // nothing known about this name => the caller has to wait.
+   std::string error;
+   const auto result = lookup(key, error);
+   store(key, result, error);
+   if (!result) {
+      throw std::runtime_error{error};
+   }
+   return result;
+} // dns_cache::resolve
+
+void SuS::logfile::dns_cache::set_ttl(
+      unsigned _ttl_s, unsigned _negative_ttl_s) {
+   std::lock_guard<std::mutex> lk(m_mutex);
+   m_ttl = std::chrono::seconds(_ttl_s);
+   m_negative_ttl = std::chrono::seconds(_negative_ttl_s);
+} // dns_cache::set_ttl
+
+SuS::logfile::dns_cache::result_t SuS::logfile::dns_cache::lookup(
+      const key_t &_key, std::string &_error) {
+   ::addrinfo hints, *res;
+   ::memset(&hints, 0, sizeof hints);
+   hints.ai_family = AF_UNSPEC;
+   hints.ai_socktype = SOCK_STREAM;
+
+   const auto status = ::getaddrinfo(_key.first.c_str(),
+         std::to_string(_key.second).c_str(), &hints, &res);
+   if (status != 0) {
+      _error = "getaddrinfo(" + _key.first + ") failed: " +
+            ::gai_strerror(status);
+      SuS_LOG(warning, log_id(), _error);
+      return result_t{};
+   }
+   if (!res) {
+      _error = "getaddrinfo(" + _key.first + ") returned no address.";
+      SuS_LOG(warning, log_id(), _error);
+      return result_t{};
+   }
+   return result_t{res, ::freeaddrinfo};
+} // dns_cache::lookup
+
+void SuS::logfile::dns_cache::store(const key_t &_key,
+      const result_t &_result, const std::string &_error) {
+   std::lock_guard<std::mutex> lk(m_mutex);
+   auto &e = m_entries[_key];
+   e.refreshing = false;
+   if (_result) {
+      e.addresses = _result;
+      e.error.clear();
+      e.expires = clock::now() + m_ttl;
+   } else {
+      // keep the old addresses (if any): a failing resolver is no reason to
+      // stop using them. try again after the negative TTL.
+      e.error = _error;
+      e.expires = clock::now() + m_negative_ttl;
+      if (e.addresses) {
+         SuS_LOG_STREAM(info, log_id(),
+               "Keeping the last known addresses of " << _key.first << ".");
+      }
+   }
+} // dns_cache::store
+
+void SuS::logfile::dns_cache::run() {
+   crash_log::install_signal_stack();
+   while (true) {
+      key_t key;
+      {
+         std::unique_lock<std::mutex> lk(m_mutex);
+         m_cv.wait(lk, [this]() { return !m_refresh_queue.empty(); });
+         key = m_refresh_queue.front();
+         m_refresh_queue.pop_front();
+      }
+      SuS_LOG_STREAM(finest, log_id(), "Refreshing " << key.first << ".");
+      std::string error;
+      const auto result = lookup(key, error);
+      store(key, result, error);
+   }
+} // dns_cache::run
+#endif
@@ -0,0 +1,102 @@
+/* SPDX-License-Identifier: MIT */
+/*! @file */
+#pragma once
+
+#include "config.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+#ifdef HAVE_NETDB_H
+#include <netdb.h>
+#endif
+#ifdef _WINDOWS
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#endif
+
+namespace SuS {
+namespace logfile {
+
+//! Process-wide cache of getaddrinfo results.
+/*!
+ * Reconnects should not wait for the resolver, in particular not during a
+ * DNS outage, where every call of getaddrinfo blocks for the resolver
+ * timeout. Therefore:
+ * - Results are kept for a TTL. getaddrinfo does not report the TTL of the
+ *   DNS records, so a fixed value is used.
+ * - When an entry is older than the TTL, the last known addresses are
+ *   still returned right away and the name is resolved again in the
+ *   background. If that fails, the old addresses stay in use.
+ * - Failures are cached as well (negative TTL), so that a name that does
+ *   not resolve does not cost a blocking call on every retry.
+ *
+ * Only the very first resolution of a name blocks the caller.
+ */
+class dns_cache {
+ public:
+   //! The getaddrinfo result. Shared with the cache, do not modify.
+   typedef std::shared_ptr<const ::addrinfo> result_t;
+
+   //! Get the process-wide instance. It is never destroyed.
+   static dns_cache *instance();
+
+   //! Resolve _host for a stream connection to _port.
+   /*!
+    * @return The addresses as returned by getaddrinfo. Never empty.
+    * @throw std::runtime_error The name could not be resolved.
+    */
+   result_t resolve(const std::string &_host, uint16_t _port);
+
+   //! Set how long results are used without resolving them again.
+   /*!
+    * @param _ttl_s Lifetime of a successful resolution.
+    * @param _negative_ttl_s Lifetime of a failed resolution.
+    */
+   void set_ttl(unsigned _ttl_s, unsigned _negative_ttl_s);
+
+ private:
+   typedef std::chrono::steady_clock clock;
+   typedef std::pair<std::string, uint16_t> key_t;
+
+   struct entry {
+      //! The last successful result. Null, if there was none yet.
+      result_t addresses;
+      //! Message of the last failure, if addresses is null.
+      std::string error;
+      //! The entry is used without resolving again until then.
+      clock::time_point expires;
+      //! A refresh is queued for the background thread.
+      bool refreshing{false};
+   };
+
+   dns_cache();
+   ~dns_cache() = delete;
+
+   //! Call getaddrinfo. Returns null and sets _error on failure.
+   static result_t lookup(const key_t &_key, std::string &_error);
+   void store(const key_t &_key, const result_t &_result,
+         const std::string &_error);
+   //! The background thread refreshing expired entries.
+   void run();
+
+   std::mutex m_mutex;
+   std::condition_variable m_cv;
+   std::map<key_t, entry> m_entries;
+   std::deque<key_t> m_refresh_queue;
+   clock::duration m_ttl{std::chrono::seconds(60)};
+   clock::duration m_negative_ttl{std::chrono::seconds(10)};
+
+   std::thread m_thread;
+}; // class dns_cache
+
+} // namespace logfile
+} // namespace SuS
@@ -0,0 +1,279 @@
+/* SPDX-License-Identifier: MIT */
+#include "fd_poller.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <stdexcept>
+#include <string.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#else
+#include <sys/types.h>
+#endif
+
+namespace {
+#ifdef HAVE_SYS_EPOLL_H
+uint32_t to_epoll(unsigned _events) {
+   uint32_t ret = 0U;
+   if (_events & SuS::logfile::fd_poller::readable) {
+      ret |= EPOLLIN | EPOLLRDHUP;
+   }
+   if (_events & SuS::logfile::fd_poller::writable) {
+      ret |= EPOLLOUT;
+   }
+   return ret;
+}
+
+unsigned from_epoll(uint32_t _events) {
+   unsigned ret = 0U;
+   if (_events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+      ret |= SuS::logfile::fd_poller::readable;
+   }
+   if (_events & EPOLLOUT) {
+      ret |= SuS::logfile::fd_poller::writable;
+   }
+   if (_events & EPOLLERR) {
+      ret |= SuS::logfile::fd_poller::error;
+   }
+   return ret;
+}
+#endif
+
+#ifdef HAVE_POLL_H
+short to_poll(unsigned _events) {
+   short ret = 0;
+   if (_events & SuS::logfile::fd_poller::readable) {
+      ret |= POLLIN;
+   }
+   if (_events & SuS::logfile::fd_poller::writable) {
+      ret |= POLLOUT;
+   }
+   return ret;
+}
+
+unsigned from_poll(short _events) {
+   unsigned ret = 0U;
+   // a hang-up is reported as readable: read() then returns 0.
+   if (_events & (POLLIN | POLLHUP)) {
+      ret |= SuS::logfile::fd_poller::readable;
+   }
+   if (_events & POLLOUT) {
+      ret |= SuS::logfile::fd_poller::writable;
+   }
+   if (_events & (POLLERR | POLLNVAL)) {
+      ret |= SuS::logfile::fd_poller::error;
+   }
+   return ret;
+}
+#endif
+} // namespace
+
+#ifdef HAVE_SYS_EPOLL_H
+SuS::logfile::fd_poller::fd_poller()
+   : m_epoll_fd(::epoll_create1(EPOLL_CLOEXEC)) {
+   if (m_epoll_fd < 0) {
+      throw std::runtime_error{"epoll_create1 failed."};
+   }
+} // fd_poller constructor
+
+SuS::logfile::fd_poller::~fd_poller() {
+   ::close(m_epoll_fd);
+} // fd_poller destructor
+
+void SuS::logfile::fd_poller::add(int _fd, unsigned _events, void *_user) {
+   ::epoll_event ev;
+   ev.events = to_epoll(_events);
+   ev.data.fd = _fd;
+   if (::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, _fd, &ev) != 0) {
+      throw std::runtime_error{"epoll_ctl(ADD) failed."};
+   }
+   m_user[_fd] = _user;
+} // fd_poller::add
+
+void SuS::logfile::fd_poller::modify(int _fd, unsigned _events, void *_user) {
+   ::epoll_event ev;
+   ev.events = to_epoll(_events);
+   ev.data.fd = _fd;
+   if (::epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, _fd, &ev) != 0) {
+      throw std::runtime_error{"epoll_ctl(MOD) failed."};
+   }
+   m_user[_fd] = _user;
+} // fd_poller::modify
+
+void SuS::logfile::fd_poller::remove(int _fd) {
+   // the event argument is ignored, but must not be nullptr before 2.6.9.
+   ::epoll_event ev;
+   ::epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, _fd, &ev);
+   m_user.erase(_fd);
+} // fd_poller::remove
+
+size_t SuS::logfile::fd_poller::wait(
+      std::vector<event> &_events, int _timeout_ms) {
+   _events.clear();
+   ::epoll_event evs[64];
+   const auto rc = ::epoll_wait(m_epoll_fd, evs, 64, _timeout_ms);
+   if (rc < 0) {
+      if (errno == EINTR) {
+         return 0U;
+      }
+      throw std::runtime_error{"epoll_wait failed."};
+   }
+   for (int i = 0; i < rc; ++i) {
+      const auto fd = evs[i].data.fd;
+      _events.push_back(event{fd, from_epoll(evs[i].events), m_user[fd]});
+   }
+   return _events.size();
+} // fd_poller::wait
+#elif defined HAVE_POLL_H
+SuS::logfile::fd_poller::fd_poller() {
+} // fd_poller constructor
+
+SuS::logfile::fd_poller::~fd_poller() {
+} // fd_poller destructor
+
+void SuS::logfile::fd_poller::add(int _fd, unsigned _events, void *_user) {
+   m_fds.push_back(::pollfd{_fd, to_poll(_events), 0});
+   m_user[_fd] = _user;
+} // fd_poller::add
+
+void SuS::logfile::fd_poller::modify(int _fd, unsigned _events, void *_user) {
+   for (auto &i : m_fds) {
+      if (i.fd == _fd) {
+         i.events = to_poll(_events);
+      }
+   }
+   m_user[_fd] = _user;
+} // fd_poller::modify
+
+void SuS::logfile::fd_poller::remove(int _fd) {
+   m_fds.erase(std::remove_if(m_fds.begin(), m_fds.end(),
+                     [_fd](const ::pollfd &_p) { return _p.fd == _fd; }),
+         m_fds.end());
+   m_user.erase(_fd);
+} // fd_poller::remove
+
+size_t SuS::logfile::fd_poller::wait(
+      std::vector<event> &_events, int _timeout_ms) {
+   _events.clear();
+   const auto rc = ::poll(m_fds.data(), m_fds.size(), _timeout_ms);
+   if (rc < 0) {
+      if (errno == EINTR) {
+         return 0U;
+      }
+      throw std::runtime_error{"poll failed."};
+   }
+   for (const auto &i : m_fds) {
+      if (i.revents) {
+         _events.push_back(event{i.fd, from_poll(i.revents), m_user[i.fd]});
+      }
+   }
+   return _events.size();
+} // fd_poller::wait
+#else
+SuS::logfile::fd_poller::fd_poller() {
+   throw std::logic_error{"fd_poller needs epoll or poll()."};
+} // fd_poller constructor
+
+SuS::logfile::fd_poller::~fd_poller() {
+} // fd_poller destructor
+
+void SuS::logfile::fd_poller::add(int, unsigned, void *) {
+} // fd_poller::add
+
+void SuS::logfile::fd_poller::modify(int, unsigned, void *) {
+} // fd_poller::modify
+
+void SuS::logfile::fd_poller::remove(int) {
+} // fd_poller::remove
+
+size_t SuS::logfile::fd_poller::wait(std::vector<event> &, int) {
+   return 0U;
+} // fd_poller::wait
+#endif
+
+unsigned SuS::logfile::fd_poller::wait_one(
+      int _fd, unsigned _events, uint_fast64_t _timeout_us) {
+   typedef std::chrono::steady_clock clock;
+   const auto deadline = clock::now() + std::chrono::microseconds(_timeout_us);
+   // time left until the deadline. a signal must not cut the wait short.
+   const auto remaining_us = [&deadline]() -> uint_fast64_t {
+      const auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+            deadline - clock::now())
+                            .count();
+      // at least 1, since 0 means forever.
+      return us > 0 ? uint_fast64_t(us) : 1U;
+   };
+   auto timeout_us = _timeout_us;
+#ifdef HAVE_POLL_H
+   ::pollfd pfd{_fd, to_poll(_events), 0};
+   while (true) {
+      // round up, so that short timeouts do not become a busy loop.
+      const auto timeout_ms =
+            (timeout_us == 0) ? -1 : int((timeout_us + 999U) / 1000U);
+      const auto rc = ::poll(&pfd, 1, timeout_ms);
+      if (rc < 0) {
+         if (errno == EINTR) {
+            if (_timeout_us) {
+               timeout_us = remaining_us();
+            }
+            continue;
+         }
+         throw std::runtime_error{"poll failed."};
+      }
+      return (rc == 0) ? 0U : from_poll(pfd.revents);
+   }
+#else
+   while (true) {
+      ::fd_set read_set, write_set, except_set;
+      FD_ZERO(&read_set);
+      FD_ZERO(&write_set);
+      FD_ZERO(&except_set);
+      if (_events & readable) {
+         FD_SET(_fd, &read_set);
+      }
+      if (_events & writable) {
+         FD_SET(_fd, &write_set);
+      }
+      FD_SET(_fd, &except_set);
+      ::timeval timeout;
+      timeout.tv_sec = timeout_us / 1000000U;
+      timeout.tv_usec = timeout_us % 1000000U;
+      const auto to = (timeout_us == 0) ? nullptr : &timeout;
+#ifdef _WINDOWS
+      const auto rc = select(1, &read_set, &write_set, &except_set, to);
+#else
+      const auto rc = select(_fd + 1, &read_set, &write_set, &except_set, to);
+      if ((rc < 0) && (errno == EINTR)) {
+         if (_timeout_us) {
+            timeout_us = remaining_us();
+         }
+         continue;
+      }
+#endif
+      if (rc < 0) {
+         throw std::runtime_error{"Select failed."};
+      }
+      unsigned ret = 0U;
+      if (FD_ISSET(_fd, &read_set)) {
+         ret |= readable;
+      }
+      if (FD_ISSET(_fd, &write_set)) {
+         ret |= writable;
+      }
+      if (FD_ISSET(_fd, &except_set)) {
+         ret |= error;
+      }
+      return ret;
+   }
+#endif
+} // fd_poller::wait_one
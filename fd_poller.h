@@ -0,0 +1,87 @@
+/* SPDX-License-Identifier: MIT */
+/*! @file */
+#pragma once
+
+#include "config.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+namespace SuS {
+namespace logfile {
+
+//! Readiness notification for file descriptors.
+/*!
+ * Uses epoll where available and poll() otherwise. In contrast to
+ * select(), neither backend is limited to descriptors below FD_SETSIZE, and
+ * the set of watched descriptors is kept between calls to \ref wait.
+ */
+class fd_poller {
+ public:
+   //! Event flags, to be or-ed.
+   enum : unsigned {
+      readable = 1U, ///< Data can be read (or the peer closed).
+      writable = 2U, ///< Data can be written.
+      error = 4U     ///< An error condition (only reported, never requested).
+   };
+
+   //! A descriptor that is ready.
+   struct event {
+      int fd;
+      unsigned events;
+      void *user;
+   };
+
+   fd_poller();
+   ~fd_poller();
+
+   fd_poller(const fd_poller &) = delete;
+   fd_poller &operator=(const fd_poller &) = delete;
+
+   //! Start watching _fd for _events.
+   /*!
+    * @param _user Handed back with every event for _fd.
+    */
+   void add(int _fd, unsigned _events, void *_user = nullptr);
+   //! Change the events watched for _fd.
+   void modify(int _fd, unsigned _events, void *_user = nullptr);
+   //! Stop watching _fd.
+   void remove(int _fd);
+
+   //! Wait for at least one watched descriptor to become ready.
+   /*!
+    * @param _events Receives the ready descriptors (cleared first).
+    * @param _timeout_ms Timeout in ms. Negative to wait forever.
+    * @return Number of ready descriptors. 0 on timeout or EINTR.
+    */
+   size_t wait(std::vector<event> &_events, int _timeout_ms);
+
+   //! Wait for a single descriptor without registering it.
+   /*!
+    * @param _fd The descriptor to watch.
+    * @param _events The events to wait for.
+    * @param _timeout_us Timeout in microseconds. 0 to wait forever.
+    * Interrupted system calls are restarted with the remaining time.
+    * @return The events that occurred. 0 on timeout.
+    */
+   static unsigned wait_one(
+         int _fd, unsigned _events, uint_fast64_t _timeout_us);
+
+ private:
+#ifdef HAVE_SYS_EPOLL_H
+   int m_epoll_fd;
+#elif defined HAVE_POLL_H
+   std::vector<::pollfd> m_fds;
+#endif
+   //! The user pointers given to \ref add, by descriptor.
+   std::map<int, void *> m_user;
+}; // class fd_poller
+
+} // namespace logfile
+} // namespace SuS
@@ -0,0 +1,97 @@
+/* SPDX-License-Identifier: MIT */
+#include "latency_histogram.h"
+
+#include <cmath>
+
+namespace {
+// position of the highest bit set. _v != 0.
+unsigned msb(uint64_t _v) {
+#if defined __GNUC__ || defined __clang__
+   return 63U - unsigned(__builtin_clzll(_v));
+#else
+   unsigned ret = 0U;
+   while (_v >>= 1U) {
+      ++ret;
+   }
+   return ret;
+#endif
+}
+} // namespace
+
+SuS::logfile::latency_histogram::latency_histogram() {
+   for (auto &i : m_buckets) {
+      i.store(0U, std::memory_order_relaxed);
+   }
+} // latency_histogram constructor
+
+void SuS::logfile::latency_histogram::record(clock::duration _d) {
+   const auto ns =
+         std::chrono::duration_cast<std::chrono::nanoseconds>(_d).count();
+   // the steady clock does not go backwards, but be safe.
+   m_buckets[bucket(ns > 0 ? uint64_t(ns) : 0U)].fetch_add(
+         1U, std::memory_order_relaxed);
+} // latency_histogram::record
+
+unsigned long long SuS::logfile::latency_histogram::count() const {
+   unsigned long long ret = 0U;
+   for (const auto &i : m_buckets) {
+      ret += i.load(std::memory_order_relaxed);
+   }
+   return ret;
+} // latency_histogram::count
+
+std::chrono::nanoseconds SuS::logfile::latency_histogram::percentile(
+      double _p) const {
+   // copy first: the buckets change while we look at them.
+   unsigned long long counts[s_buckets];
+   unsigned long long total = 0U;
+   for (unsigned i = 0U; i < s_buckets; ++i) {
+      counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+      total += counts[i];
+   }
+   if (!total) {
+      return std::chrono::nanoseconds{0};
+   }
+   const auto rank = (unsigned long long)(std::ceil(_p * double(total)));
+   unsigned long long seen = 0U;
+   for (unsigned i = 0U; i < s_buckets; ++i) {
+      seen += counts[i];
+      if (seen >= rank && counts[i]) {
+         return std::chrono::nanoseconds(upper_bound(i));
+      }
+   }
+   return std::chrono::nanoseconds(upper_bound(s_buckets - 1U));
+} // latency_histogram::percentile
+
+void SuS::logfile::latency_histogram::get(
+      logger_metrics::latency &_latency) const {
+   const auto us = [this](double _p) {
+      return double(percentile(_p).count()) / 1000.;
+   };
+   _latency.count = count();
+   _latency.p50 = us(0.5);
+   _latency.p99 = us(0.99);
+   _latency.p999 = us(0.999);
+} // latency_histogram::get
+
+unsigned SuS::logfile::latency_histogram::bucket(uint64_t _ns) {
+   // below s_sub_buckets, every value has a bucket of its own.
+   if (_ns < s_sub_buckets) {
+      return unsigned(_ns);
+   }
+   // e.g. 8..15 => 8 + 0..7, 16..31 => 16 + (0..15)/2, ...
+   const auto bits = msb(_ns);
+   const auto shift = bits - 3U;
+   return (bits - 2U) * s_sub_buckets +
+          unsigned((_ns >> shift) & (s_sub_buckets - 1U));
+} // latency_histogram::bucket
+
+uint64_t SuS::logfile::latency_histogram::upper_bound(unsigned _bucket) {
+   if (_bucket < s_sub_buckets) {
+      return _bucket;
+   }
+   const auto shift = _bucket / s_sub_buckets - 1U;
+   const auto sub = _bucket % s_sub_buckets;
+   // (8 + sub) << shift is the lower end.
+   return ((uint64_t(s_sub_buckets + sub + 1U)) << shift) - 1U;
+} // latency_histogram::upper_bound
@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: MIT */
+/*! @file */
+#pragma once
+
+#include "logger_metrics.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace SuS {
+namespace logfile {
+
+//! Lock-free log-linear histogram of durations.
+/*!
+ * Every power of two is split into \ref s_sub_buckets buckets, so a value
+ * is known up to 1/8 (12.5 %) of it, from nanoseconds to centuries, in a
+ * fixed array. Recording is one relaxed increment, so any number of
+ * threads can record at the same time.
+ */
+class latency_histogram {
+ public:
+   typedef std::chrono::steady_clock clock;
+
+   latency_histogram();
+   latency_histogram(const latency_histogram &) = delete;
+   latency_histogram &operator=(const latency_histogram &) = delete;
+
+   void record(clock::duration _d);
+
+   //! Number of values recorded.
+   unsigned long long count() const;
+
+   //! The value below which the fraction _p of the values lies.
+   /*!
+    * @param _p 0.5 for the median, 0.99 for the 99th percentile, ...
+    * @return The upper end of the bucket holding the value. 0, if nothing
+    *    has been recorded.
+    */
+   std::chrono::nanoseconds percentile(double _p) const;
+
+   //! Summarize for logger_metrics.
+   void get(logger_metrics::latency &_latency) const;
+
+   static const unsigned s_sub_buckets = 8U;
+   static const unsigned s_buckets = 64U * s_sub_buckets;
+
+ private:
+   static unsigned bucket(uint64_t _ns);
+   static uint64_t upper_bound(unsigned _bucket);
+
+   std::atomic<unsigned long long> m_buckets[s_buckets];
+}; // class latency_histogram
+
+} // namespace logfile
+} // namespace SuS
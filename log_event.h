@@ -19,6 +19,11 @@ struct log_event {
    std::string function;
    mutable std::string subsystem_string;
    mutable std::string time_string;
+   //! The event stands for this many events: it was sampled 1 in
+   //! sample_rate. 1 for events that were not sampled.
+   unsigned sample_rate;
+   //! When logger::log was called, for the latency histograms.
+   std::chrono::steady_clock::time_point submit_time;
 }; // struct log_event
 
 //! Format time as string in ISO format.
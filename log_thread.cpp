@@ -7,12 +7,13 @@
 #include "log_thread.h"
 
 #include "config.h"
+#include "crash_log.h"
 #include "log_event.h"
 #include "output_stream_stdout.h"
-#include "retry_thread.h"
 
 #include <algorithm>
 #include <cassert>
+#include <functional>
 #include <sstream>
 #include <string.h>
 #ifdef HAVE_PRCTL
@@ -24,10 +25,8 @@ SuS::logfile::log_thread::log_thread() : m_thread(), m_do_terminate(false) {
 } // log_thread constructor
 
 SuS::logfile::log_thread::~log_thread() {
-#if 0
-   std::cout << "max event queue size: " << m_max_event_queue_size
-      << std::endl << std::endl;
-#endif
+   // the scheduler must not touch the streams while they are deleted.
+   m_retry.stop();
 
    // doesn't work with QLogList: Gets freed by Qt
    // but live with that crash on exit for now instead of penalizing all
@@ -51,6 +50,7 @@ void SuS::logfile::log_thread::start() {
 } // log_thread::start
 
 void SuS::logfile::log_thread::run(log_thread *_instance) {
+   crash_log::install_signal_stack();
 // additionally check for PR_GET_NAME since the prctl function is older than
 // PR_GET_NAME (and PR_GET_NAME is newer than PR_SET_NAME).
 #if defined HAVE_PRCTL && defined PR_GET_NAME
@@ -77,38 +77,101 @@ void SuS::logfile::log_thread::terminate() {
    join();
 } // log_thread::terminate
 
+void SuS::logfile::log_thread::attach(output_stream *_stream) {
+   m_retry.attach(_stream);
+} // log_thread::attach
+
+void SuS::logfile::log_thread::metrics(logger_metrics &_metrics) {
+   {
+      std::lock_guard<std::mutex> lk(m_mutex);
+      _metrics.queue_depth = m_events.size();
+      _metrics.max_queue_depth = m_max_event_queue_size;
+   }
+   m_queue_latency.get(_metrics.queue);
+   for (const auto &i : m_streams) {
+      logger_metrics::sink s;
+      s.name = i.first;
+      s.written = i.second->written();
+      s.failed = i.second->failed();
+      i.second->get_latency(s);
+      m_retry.metrics(i.second, s);
+      _metrics.sinks.push_back(std::move(s));
+   }
+} // log_thread::metrics
+
+void SuS::logfile::log_thread::forget(output_stream *_stream) {
+   m_retry.forget(_stream);
+} // log_thread::forget
+
+void SuS::logfile::log_thread::set_coalescing(
+      std::chrono::milliseconds _window) {
+   m_coalesce_window = _window.count();
+   // wake up the thread, in case it waits for the end of a window.
+   m_cond.notify_one();
+} // log_thread::set_coalescing
+
+std::chrono::milliseconds SuS::logfile::log_thread::coalescing() const {
+   return std::chrono::milliseconds(m_coalesce_window.load());
+} // log_thread::coalescing
+
+void SuS::logfile::log_thread::coalesce(const log_event &_event) {
+   const auto window = coalescing();
+   if (!window.count()) {
+      flush_repeats();
+      m_have_last = false;
+      log(_event);
+      return;
+   }
+
+   // compare the hashes first, most events differ.
+   auto hash = std::hash<std::string>{}(_event.message);
+   hash ^= std::hash<std::string>{}(_event.function) + 0x9e3779b9U +
+           (hash << 6) + (hash >> 2);
+   hash ^= (size_t(_event.subsystem) << 3) ^ size_t(_event.level);
+   if (m_have_last && (hash == m_last_hash) &&
+         (_event.time - m_last_event.time <= window) &&
+         (_event.subsystem == m_last_event.subsystem) &&
+         (_event.level == m_last_event.level) &&
+         (_event.message == m_last_event.message) &&
+         (_event.function == m_last_event.function)) {
+      ++m_repeats;
+      m_last_repeat = _event.time;
+      return;
+   }
+   flush_repeats();
+   log(_event);
+   m_last_event = _event;
+   m_last_hash = hash;
+   m_have_last = true;
+} // log_thread::coalesce
+
+void SuS::logfile::log_thread::flush_repeats() {
+   if (!m_repeats) {
+      return;
+   }
+   auto summary = m_last_event;
+   std::ostringstream message;
+   message << "last message repeated " << m_repeats << " times within "
+           << std::chrono::duration_cast<std::chrono::milliseconds>(
+                    m_last_repeat - m_last_event.time)
+                    .count()
+           << " ms";
+   summary.message = message.str();
+   summary.time = m_last_repeat;
+   m_repeats = 0U;
+   log(summary);
+} // log_thread::flush_repeats
+
 void SuS::logfile::log_thread::log(const log_event &_event) {
    _event.time_string = format_time(_event.time);
 
    for (const auto &j : m_streams) {
-      auto t = m_retry_map.find(j.second);
-      if (t != m_retry_map.end()) {
-         if (!t->second) {
-            m_retry_map.erase(t);
-         } else if (!t->second->active()) {
-            // the retry thread's queue is empty => back to normal operation
-            t->second->m_thread.join();
-            delete t->second;
-            m_retry_map.erase(t);
-         } else {
-            t->second->enqueue(_event);
-            continue;
-         } // else
-      }    // if
-
+      // queued behind earlier events, while the sink is being retried.
+      if (m_retry.divert(j.second, _event)) {
+         continue;
+      }
       if (!j.second->write(_event)) {
-         retry_thread *thread = nullptr;
-         try {
-            thread = new retry_thread(j.second);
-         } catch (const std::system_error &e) {
-            std::cerr << "Initializing retry_thread: Caught system_error "
-                         "with code " << e.code() << ", meaning " << e.what()
-                      << std::endl;
-         }
-         if (thread) {
-            thread->enqueue(_event);
-            m_retry_map.emplace(j.second, thread);
-         }
+         m_retry.failed(j.second, _event);
       }
    } // for j
 } // log_thread::log
@@ -121,10 +184,16 @@ void SuS::logfile::log_thread::do_run() {
       m_mutex.lock();
       m_events.swap(local); // swap is O(1) => mutex is not locked for long
       m_mutex.unlock();
+#ifdef LATENCY_HISTOGRAMS
+      const auto dequeued = latency_histogram::clock::now();
+#endif
 
       // now take our time to process the events
       for (const auto &i : local) {
-         log(i);
+#ifdef LATENCY_HISTOGRAMS
+         m_queue_latency.record(dequeued - i.submit_time);
+#endif
+         coalesce(i);
       } // while
       local.clear();
 
@@ -132,17 +201,8 @@ void SuS::logfile::log_thread::do_run() {
       std::unique_lock<std::mutex> lock(m_mutex);
       if (m_do_terminate && m_events.empty()) {
          lock.unlock();
-         auto still_active = false;
-         for (auto &i : m_retry_map) {
-            if (i.second->active()) {
-               still_active = true;
-            } else {
-               i.second->m_thread.join();
-               delete i.second;
-               i.second = nullptr;
-            }
-         }
-         if (still_active) {
+         flush_repeats();
+         if (m_retry.active()) {
             // avoid a tight loop
             std::this_thread::sleep_for(std::chrono::seconds(1U));
             // and do not wait for a signal
@@ -151,11 +211,11 @@ void SuS::logfile::log_thread::do_run() {
             lock.lock();
             if (m_events.empty()) {
                // no messages in our queue
-               // + no retry threads still active
+               // + nothing left to retry
                // => thread done
                return;
             } else {
-               // more messages arrived while we checked the retry threads.
+               // more messages arrived while we checked the retry queues.
                lock.unlock();
                continue;
             }
@@ -166,7 +226,16 @@ void SuS::logfile::log_thread::do_run() {
       if (m_events.empty()) {
          // m_events.size > 0: events have been put in the queue in the
          // meantime. their cond_signal events have been missed!
-         m_cond.wait(lock);
+         if (!m_repeats) {
+            m_cond.wait(lock);
+         } else if ((m_cond.wait_until(lock,
+                           m_last_event.time + coalescing()) ==
+                          std::cv_status::timeout) &&
+                    m_events.empty()) {
+            // the window closed without a further repeat.
+            lock.unlock();
+            flush_repeats();
+         }
       } // if
    }    // while
 } // log_thread::do_run
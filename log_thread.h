@@ -1,9 +1,13 @@
 /* SPDX-License-Identifier: MIT */
 #pragma once
 
+#include "latency_histogram.h"
 #include "log_event.h"
 #include "logger.h"
+#include "retry_scheduler.h"
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <map>
 #include <thread>
@@ -12,17 +16,19 @@ namespace SuS {
 namespace logfile {
 
 class output_stream;
-class retry_thread;
 
 //! The thread handling the distribution of the log messages.
 /*! When a log message is sent, it is put in a FIFO queue of the thread
  *  (\ref m_events). The application then resumes. From within the logging
  *  thread, the message is picked from the queue and processed by passing it
- *  to all configured sinks in turn. When the delivery fails for a sink, a
- *  \ref retry_thread is started for the sink and further messages for the
- *  sink are queue in the retry thread of the sink instead of directly trying
- *  to deliver to the sink. When all messages queued in the retry thread have
- *  been delivered, normal delivery resumes.
+ *  to all configured sinks in turn. When the delivery fails for a sink, the
+ *  \ref retry_scheduler takes over the sink and further messages for the
+ *  sink are queued there instead of directly trying to deliver to the sink.
+ *  When all messages queued for the sink have been delivered, normal
+ *  delivery resumes.
+ *
+ *  Optionally, consecutive identical messages are collapsed before they
+ *  reach the sinks (see logger::set_coalescing).
  */
 class log_thread {
  public:
@@ -41,6 +47,19 @@ class log_thread {
    typedef std::map<std::string, output_stream *> stream_list_t;
    stream_list_t m_streams;
 
+   //! Resume retries spooled for a stream by an earlier run.
+   void attach(output_stream *_stream);
+
+   //! Fill in the queue depths and the counters of the streams.
+   void metrics(logger_metrics &_metrics);
+
+   //! Drop the queued retries for a stream before it is deleted.
+   void forget(output_stream *_stream);
+
+   //! Collapse repeated events within _window. 0 turns it off.
+   void set_coalescing(std::chrono::milliseconds _window);
+   std::chrono::milliseconds coalescing() const;
+
  private:
    //! List of log events waiting to be processed.
    event_queue_t m_events;
@@ -48,6 +67,11 @@ class log_thread {
    //! Deliver a log message.
    void log(const log_event &_event);
 
+   //! Deliver _event, unless it repeats the last one.
+   void coalesce(const log_event &_event);
+   //! Deliver the summary of the repeats of the last event, if any.
+   void flush_repeats();
+
    //! Helper function to start the logging thread.
    static void run(log_thread *_instance);
 
@@ -64,8 +88,22 @@ class log_thread {
 
    size_t m_max_event_queue_size{0};
 
-   typedef std::map<output_stream *, retry_thread *> retry_map_t;
-   retry_map_t m_retry_map;
+   //! Retries the delivery to failed sinks.
+   retry_scheduler m_retry;
+
+   //! From the call of logger::log until the events are taken here.
+   latency_histogram m_queue_latency;
+
+   //! Window for coalescing repeated events in ms. 0 means off.
+   std::atomic<std::chrono::milliseconds::rep> m_coalesce_window{0};
+   //! The last event delivered while coalescing. Only one is kept: only
+   //! consecutive repeats are collapsed.
+   log_event m_last_event;
+   size_t m_last_hash{0U};
+   bool m_have_last{false};
+   //! Repeats of m_last_event not delivered so far.
+   unsigned long m_repeats{0U};
+   std::chrono::system_clock::time_point m_last_repeat;
 }; // class log_thread
 
 } // namespace logfile
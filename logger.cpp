@@ -2,9 +2,10 @@
 #include "logger.h"
 
 #include "config.h"
-#include "line_splitter.h"
+#include "crash_log.h"
 #include "log_thread.h"
 #include "log_event.h"
+#include "logger_metrics.h"
 #include "logger_private.h"
 #include "output_stream.h"
 #include "subsystem_registrator.h"
@@ -29,7 +30,6 @@
 #ifdef __unix__
 #include <stdio.h>
 #include <sys/types.h>
-#include <sys/wait.h>
 #include <unistd.h>
 #endif
 
@@ -45,12 +45,7 @@ void (*SuS::logfile::logger::s_old_sighandler)(int) = nullptr;
 
 SuS::logfile::logger::logger() : m_d(new logger_private) {
 #ifdef HAVE_SIGACTION
-   struct ::sigaction sa, old_sa;
-   sa.sa_handler = signal_handler;
-   sigemptyset(&sa.sa_mask);
-   sa.sa_flags = SA_RESTART;
-   ::sigaction(SIGSEGV, &sa, &old_sa);
-   s_old_sighandler = old_sa.sa_handler;
+   crash_log::install();
 #else
    s_old_sighandler = ::signal(SIGSEGV, signal_handler);
 #endif
@@ -83,18 +78,81 @@ SuS::logfile::logger *SuS::logfile::logger::instance() {
 } // logger::instance
 
 void SuS::logfile::logger::log(log_level _level, const subsystem_t _subsystem,
-      const std::string &_message, const std::string &_function) {
+      const std::string &_message, const std::string &_function,
+      unsigned _sample_rate) {
+#ifdef LATENCY_HISTOGRAMS
+   const auto start = latency_histogram::clock::now();
+#else
+   const latency_histogram::clock::time_point start;
+#endif
    const auto i = m_d->m_subsystems.find(_subsystem);
    assert(i != m_d->m_subsystems.end());
+   auto &counters = *i->second.counters;
    if (_level < i->second.min_level) {
+      counters.filtered[size_t(_level)].fetch_add(
+            1U, std::memory_order_relaxed);
+      return;
+   }
+   auto &limiter = *i->second.limiter;
+   if (!limiter.admit()) {
+      counters.filtered[size_t(_level)].fetch_add(
+            1U, std::memory_order_relaxed);
       return;
    }
    const auto now = std::chrono::system_clock::now();
-   log_event le = {
-         _level, _subsystem, _message, now, _function, i->second.name, ""};
+   const auto suppressed = limiter.take_suppressed();
+   if (suppressed && (log_level::warning >= i->second.min_level)) {
+      std::ostringstream message;
+      message << "suppressed " << suppressed
+              << " messages over the rate limit";
+      m_d->m_thread->enqueue(log_event{log_level::warning, _subsystem,
+            message.str(), now, SuS_FUNCNAME, i->second.name, "", 1U, start});
+   }
+   log_event le = {_level, _subsystem, _message, now, _function,
+         i->second.name, "", _sample_rate, start};
    m_d->m_thread->enqueue(le);
+   crash_log::record(_level, i->second.name, _message, now);
+   counters.submitted[size_t(_level)].fetch_add(1U, std::memory_order_relaxed);
+#ifdef LATENCY_HISTOGRAMS
+   m_d->m_submit_latency.record(latency_histogram::clock::now() - start);
+#endif
 } // logger::log
 
+unsigned SuS::logfile::logger::sample(
+      log_level _level, const subsystem_t _subsystem) {
+   const auto i = m_d->m_subsystems.find(_subsystem);
+   assert(i != m_d->m_subsystems.end());
+   auto &filtered = i->second.counters->filtered[size_t(_level)];
+   if (_level < i->second.min_level) {
+      filtered.fetch_add(1U, std::memory_order_relaxed);
+      return 0U;
+   }
+   const auto &sampler = *i->second.sampler;
+   const auto one_in = sampler.one_in.load(std::memory_order_relaxed);
+   if ((one_in <= 1U) ||
+         (_level > sampler.max_level.load(std::memory_order_relaxed))) {
+      return 1U;
+   }
+   // xorshift64*, one state per thread => no contention.
+   static thread_local uint64_t state = 0U;
+   if (!state) {
+      state = uint64_t(std::chrono::steady_clock::now()
+                             .time_since_epoch()
+                             .count()) ^
+              uint64_t(reinterpret_cast<uintptr_t>(&state));
+      state |= 1U;
+   }
+   state ^= state >> 12;
+   state ^= state << 25;
+   state ^= state >> 27;
+   const auto random = uint32_t((state * 0x2545F4914F6CDD1DULL) >> 32);
+   if (random % one_in) {
+      filtered.fetch_add(1U, std::memory_order_relaxed);
+      return 0U;
+   }
+   return one_in;
+} // logger::sample
+
 SuS::logfile::logger::subsystem_t SuS::logfile::logger::register_subsystem(
       const std::string &_name) {
    // allow the same name to be registered several times, e.g. from separate
@@ -108,8 +166,12 @@ SuS::logfile::logger::subsystem_t SuS::logfile::logger::register_subsystem(
 
    // not found => add to list
    const auto new_id = m_d->m_next_free_subsystem_id++;
-   m_d->m_subsystems.emplace(
-         new_id, subsystem_info{_name, log_level::SuS_LOG_MINLEVEL});
+   m_d->m_subsystems.emplace(new_id,
+         subsystem_info{_name, log_level::SuS_LOG_MINLEVEL,
+               std::unique_ptr<rate_limiter>{new rate_limiter},
+               std::unique_ptr<sampling>{new sampling},
+               // () => the atomics are zeroed.
+               std::unique_ptr<subsystem_counters>{new subsystem_counters()}});
    return new_id;
 } // logger::register_subsystem
 
@@ -131,11 +193,27 @@ void SuS::logfile::logger::set_subsystem_min_log_level(
    i->second.min_level = _level;
 } // logger::set_subsystem_min_log_level
 
+void SuS::logfile::logger::set_subsystem_sampling(
+      subsystem_t _subsystem, unsigned _one_in, log_level _max_level) {
+   const auto i = m_d->m_subsystems.find(_subsystem);
+   assert(i != m_d->m_subsystems.end());
+   i->second.sampler->max_level = _max_level;
+   i->second.sampler->one_in = std::max(_one_in, 1U);
+} // logger::set_subsystem_sampling
+
+void SuS::logfile::logger::set_subsystem_rate_limit(
+      subsystem_t _subsystem, double _per_second, unsigned _burst) {
+   const auto i = m_d->m_subsystems.find(_subsystem);
+   assert(i != m_d->m_subsystems.end());
+   i->second.limiter->set(_per_second, _burst);
+} // logger::set_subsystem_rate_limit
+
 void SuS::logfile::logger::add_output_stream(
       output_stream *const _stream, const std::string &_ref) {
    // when no reference is given, refer to it by its name.
    m_d->m_thread->m_streams.emplace(
          _ref.empty() ? _stream->name() : _ref, _stream);
+   m_d->m_thread->attach(_stream);
 } // logger::add_output_stream
 
 bool SuS::logfile::logger::remove_output_stream(const std::string &_name) {
@@ -143,25 +221,76 @@ bool SuS::logfile::logger::remove_output_stream(const std::string &_name) {
    if (i == m_d->m_thread->m_streams.end())
       return false;
 
+   m_d->m_thread->forget(i->second);
    delete i->second;
    m_d->m_thread->m_streams.erase(i);
    return true;
 } // logger::remove_output_stream
 
+void SuS::logfile::logger::set_crash_fds(const std::vector<int> &_fds) {
+   crash_log::set_fds(_fds);
+} // logger::set_crash_fds
+
+void SuS::logfile::logger::install_signal_stack() {
+   crash_log::install_signal_stack();
+} // logger::install_signal_stack
+
+void SuS::logfile::logger::set_coalescing(unsigned _window_ms) {
+   m_d->m_thread->set_coalescing(std::chrono::milliseconds(_window_ms));
+} // logger::set_coalescing
+
+SuS::logfile::logger_metrics SuS::logfile::logger::metrics() {
+   logger_metrics ret;
+   for (const auto &i : m_d->m_subsystems) {
+      logger_metrics::subsystem s;
+      s.name = i.second.name;
+      const auto &counters = *i.second.counters;
+      for (size_t l = 0U; l < subsystem_counters::s_levels; ++l) {
+         logger_metrics::level_counters c;
+         c.submitted = counters.submitted[l].load(std::memory_order_relaxed);
+         c.filtered = counters.filtered[l].load(std::memory_order_relaxed);
+         if (c.submitted || c.filtered)
+            s.levels.emplace(log_level(l), c);
+      }
+      ret.subsystems.push_back(std::move(s));
+   }
+   m_d->m_submit_latency.get(ret.submit);
+   m_d->m_thread->metrics(ret);
+   return ret;
+} // logger::metrics
+
 void SuS::logfile::logger::dump_configuration(std::ostream &_stream) {
    _stream << "global min. log level (compile-time): "
            << level_name(SuS::logfile::logger::log_level::SuS_LOG_MINLEVEL)
            << std::endl;
 
+   const auto window = m_d->m_thread->coalescing();
+   _stream << "coalescing of repeated messages: ";
+   if (window.count())
+      _stream << window.count() << " ms" << std::endl;
+   else
+      _stream << "off" << std::endl;
+
    _stream << "active output streams:" << std::endl;
    for (const auto &i : m_d->m_thread->m_streams)
       i.second->dump(_stream);
 
    _stream << "active logging subsystems" << std::endl;
-   for (const auto &i : m_d->m_subsystems)
+   for (const auto &i : m_d->m_subsystems) {
       _stream << "   - " << i.second.name << std::endl
               << "     min. log level: " << level_name(i.second.min_level)
               << std::endl;
+      const auto one_in = i.second.sampler->one_in.load();
+      if (one_in > 1U)
+         _stream << "     sampling: 1 in " << one_in << " up to "
+                 << level_name(i.second.sampler->max_level) << std::endl;
+      if (i.second.limiter->rate() > 0.)
+         _stream << "     rate limit: " << i.second.limiter->rate()
+                 << " messages/s, burst " << i.second.limiter->burst()
+                 << std::endl;
+   }
+
+   metrics().print(_stream);
 } // logger::dump_configuration
 
 bool SuS::logfile::logger::set_min_log_level(
@@ -198,89 +327,42 @@ SuS::logfile::logger::all_levels() {
    return ret;
 }
 
-#ifdef __unix__
-bool SuS::logfile::logger::gdb_backtrace() {
-   // try running gdb
-   char pid[16];
-   ::snprintf(pid, 16u, "%d", getpid());
-
-   // for communication with gdb
-   int fds[2];
-   if (::pipe(fds) != 0) {
-      return false;
-   }
-
-   auto child = fork();
-   if (child == 0) {
-      ::dup2(fds[1], STDOUT_FILENO);
-      ::close(fds[0]);
-      ::close(fds[1]);
-      ::execl("/usr/bin/gdb", "gdb", "-q", "-nw", "-batch", "-p", pid, "-ex",
-            "thread apply all bt full", nullptr);
-      // if we get here, the exec failed.
-      return false;
-   }
-
-   ::close(fds[1]);
-
-   char backtracebuf[4096];
-   line_splitter ls{
-         [](const std::string &_s) { SuS_LOG(severe, log_id(), _s); }};
-   // read gdb output
-   ssize_t size = ::read(fds[0], backtracebuf, sizeof backtracebuf);
-   while (size > 0) {
-      ls.read_and_forward(backtracebuf, size);
-      size = ::read(fds[0], backtracebuf, sizeof backtracebuf);
-   }
-
-   ::close(fds[0]);
-   int status;
-   ::waitpid(child, &status, 0);
-   return (status == 0);
-}
-#else
-bool SuS::logfile::logger::gdb_backtrace() {
-   return false;
-}
-#endif
-
+// only used where crash_log cannot install its handlers.
 void SuS::logfile::logger::signal_handler(int _sig) {
    std::cout << "SIGNAL " << _sig << std::endl;
 
    SuS_LOG_STREAM(severe, log_id(), "SIGNAL " << _sig << " received.");
 
-   if (!gdb_backtrace()) {
 #ifdef HAVE_BACKTRACE_SYMBOLS
-      void *bt[30];
-      const auto bt_size = ::backtrace(bt, 30);
-      const auto bt_syms = ::backtrace_symbols(bt, bt_size);
-      for (int i = 0; i < bt_size; ++i) {
-         std::cerr << bt_syms[i] << std::endl;
-         SuS_LOG(severe, log_id(), bt_syms[i]);
-      }
+   void *bt[30];
+   const auto bt_size = ::backtrace(bt, 30);
+   const auto bt_syms = ::backtrace_symbols(bt, bt_size);
+   for (int i = 0; i < bt_size; ++i) {
+      std::cerr << bt_syms[i] << std::endl;
+      SuS_LOG(severe, log_id(), bt_syms[i]);
+   }
 #elif defined HAVE_CAPTURESTACKBACKTRACE
-      auto process = ::GetCurrentProcess();
-      ::SymInitialize(process, nullptr, TRUE);
-
-      void *stack[100];
-      const auto frames = ::CaptureStackBackTrace(0, 100, stack, nullptr);
-      auto symbol = (SYMBOL_INFO *)::calloc(
-            sizeof(SYMBOL_INFO) + 256 * sizeof(char), 1);
-      symbol->MaxNameLen = 255;
-      symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
-
-      for (unsigned i = 0; i < frames; i++) {
-         ::SymFromAddr(process, (DWORD64)(stack[i]), 0, symbol);
-         SuS_LOG_STREAM(severe, log_id(), (frames - i - 1)
-                     << ": " << symbol->Name << " - 0x" << std::hex
-                     << symbol->Address);
-      }
+   auto process = ::GetCurrentProcess();
+   ::SymInitialize(process, nullptr, TRUE);
+
+   void *stack[100];
+   const auto frames = ::CaptureStackBackTrace(0, 100, stack, nullptr);
+   auto symbol = (SYMBOL_INFO *)::calloc(
+         sizeof(SYMBOL_INFO) + 256 * sizeof(char), 1);
+   symbol->MaxNameLen = 255;
+   symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+
+   for (unsigned i = 0; i < frames; i++) {
+      ::SymFromAddr(process, (DWORD64)(stack[i]), 0, symbol);
+      SuS_LOG_STREAM(severe, log_id(), (frames - i - 1)
+                  << ": " << symbol->Name << " - 0x" << std::hex
+                  << symbol->Address);
+   }
 
-      ::free(symbol);
+   ::free(symbol);
 #else
-      SuS_LOG(severe, log_id(), "No backtrace available.");
+   SuS_LOG(severe, log_id(), "No backtrace available.");
 #endif
-   }
 
    instance()->terminate();
    if (s_old_sighandler) {
@@ -309,6 +391,18 @@ void SuS::logfile::logger::terminate() {
    } // if
 } // logger::terminate
 
+bool SuS::logfile::logger::interval_elapsed(
+      std::atomic<long long> &_next, unsigned _ms) {
+   const auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+         std::chrono::steady_clock::now().time_since_epoch())
+                          .count();
+   auto next = _next.load(std::memory_order_relaxed);
+   // only one of several threads gets through.
+   return (now >= next) &&
+          _next.compare_exchange_strong(next,
+                now + (long long)(_ms) * 1000000LL, std::memory_order_relaxed);
+} // logger::interval_elapsed
+
 std::string SuS::logfile::logger::string_format(const char *fmt, ...) {
    int size = 100;
    std::string str;
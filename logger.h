@@ -2,6 +2,7 @@
 /*! @file */
 #pragma once
 
+#include <atomic>
 #include <iosfwd>
 #include <map>
 #include <memory>
@@ -15,6 +16,7 @@
 namespace SuS {
 namespace logfile {
 
+struct logger_metrics;
 struct logger_private;
 class output_stream;
 
@@ -44,7 +46,17 @@ class LOGFILE_EXPORT logger {
     */
    void log(const log_level _level, const subsystem_t _subsystem,
          const std::string &_message,
-         const std::string &_function = "/UNKNOWN/");
+         const std::string &_function = "/UNKNOWN/",
+         unsigned _sample_rate = 1U);
+
+   //! Decide, if a message is to be logged, before it is formatted.
+   /*! This is normally called through one of the SuS_LOG macros.
+    *
+    *  @return 0, if the message is to be dropped: its level is below the
+    *     minimum of the subsystem, or it has not been sampled. Otherwise
+    *     the sample rate to pass to \ref log.
+    */
+   unsigned sample(const log_level _level, const subsystem_t _subsystem);
 
    //! Register a subsystem with the logging system.
    /*!
@@ -60,6 +72,34 @@ class LOGFILE_EXPORT logger {
 
    void set_subsystem_min_log_level(subsystem_t _subsystem, log_level _level);
 
+   //! Log only a random sample of the low-level messages of a subsystem.
+   /*!
+    *  Every message up to _max_level is logged with a probability of
+    *  1 / _one_in. Logged messages are tagged with _one_in (see
+    *  log_event::sample_rate), so that counts can be scaled back up. The
+    *  decision is taken before the message is formatted.
+    *
+    *  @param _subsystem The subsystem to sample.
+    *  @param _one_in 1 turns sampling off.
+    *  @param _max_level The highest level sampled.
+    */
+   void set_subsystem_sampling(subsystem_t _subsystem, unsigned _one_in,
+         log_level _max_level = log_level::finer);
+
+   //! Limit the rate of messages of a subsystem.
+   /*!
+    *  Messages over the limit are dropped before they are queued, so that
+    *  one subsystem cannot flood the log thread. At most once per second,
+    *  a warning with the number of dropped messages is logged along with
+    *  the next message let through.
+    *
+    *  @param _subsystem The subsystem to limit.
+    *  @param _per_second The steady rate. 0 removes the limit.
+    *  @param _burst Messages let through at once after a quiet period.
+    */
+   void set_subsystem_rate_limit(
+         subsystem_t _subsystem, double _per_second, unsigned _burst = 1U);
+
    void add_output_stream(
          output_stream *const _stream, const std::string &_name = "");
 
@@ -78,16 +118,62 @@ class LOGFILE_EXPORT logger {
     */
    bool set_min_log_level(const std::string &_stream, log_level _level);
 
+   //! Collapse repeated messages.
+   /*!
+    *  Consecutive messages with the same subsystem, level, function and
+    *  text arriving within _window_ms after the first one are not
+    *  delivered. Instead, one message tells how often it was repeated.
+    *
+    *  @param _window_ms The window in milliseconds. 0 (the default) turns
+    *     coalescing off.
+    */
+   void set_coalescing(unsigned _window_ms);
+
+   //! Set the file descriptors the crash report is written to.
+   /*!
+    *  On a fatal signal, the signal, the last events logged and a backtrace
+    *  are written to these descriptors with write(2), without going through
+    *  the log thread and the sinks. An empty list turns the report off.
+    *
+    *  Keeping the last events costs every log call a copy of up to 240
+    *  bytes, so it only starts with a call with at least one descriptor.
+    *  Before that, the report goes to stderr and has no events; call
+    *  `set_crash_fds({STDERR_FILENO})` to get them there.
+    *
+    *  @throw std::invalid_argument More than 8 descriptors.
+    */
+   static void set_crash_fds(const std::vector<int> &_fds);
+
+   //! Set up an alternate signal stack for the calling thread.
+   /*!
+    *  Needed to report a stack overflow. The logger does this for the
+    *  thread creating it and for its own threads; other threads may call
+    *  this.
+    */
+   static void install_signal_stack();
+
+   //! Take a snapshot of the counters of the logging pipeline.
+   logger_metrics metrics();
+
    //! Dump an overview of the current logger configuration.
    /*!
     *  The dump includes the minimum log level defined at compile time,
     *  a list of all active output streams with the respective active minimum
-    *  log level, and a list of all known subsystems.
+    *  log level, a list of all known subsystems, and the \ref metrics.
     *
     *  @param _stream The stream to dump to (e.g. `std::cout`).
     */
    void dump_configuration(std::ostream &_stream);
 
+   //! Check, if _ms milliseconds passed since this last returned true.
+   /*!
+    *  Helper for \ref SuS_LOG_EVERY_MS. Lock-free.
+    *
+    *  @param _next The time this returns true again, in steady clock
+    *     nanoseconds. Updated.
+    */
+   static bool interval_elapsed(std::atomic<long long> &_next, unsigned _ms);
+
    static std::string string_format(const char *fmt, ...)
 #if defined __GNUC__ || defined __clang__
          __attribute__((__format__(__printf__, 1, 2)))
@@ -107,7 +193,6 @@ class LOGFILE_EXPORT logger {
    static void (*s_old_sighandler)(int);
    static void signal_handler(int _signal);
    static void atexit_handler();
-   static bool gdb_backtrace();
 
    void terminate();
 }; // class logger
@@ -150,8 +235,12 @@ class LOGFILE_EXPORT logger {
          SuS::logfile::logger::log_level::SuS_LOG_MINLEVEL)                    \
       ;                                                                        \
    else {                                                                      \
-      SuS::logfile::logger::instance()->log(                                   \
-            SuS::logfile::logger::log_level::l, sys, msg, SuS_FUNCNAME);       \
+      const auto very_unlikely_LoGgEr = SuS::logfile::logger::instance();      \
+      if (const unsigned very_unlikely_RaTe = very_unlikely_LoGgEr->sample(    \
+                SuS::logfile::logger::log_level::l, sys)) {                    \
+         very_unlikely_LoGgEr->log(SuS::logfile::logger::log_level::l, sys,    \
+               msg, SuS_FUNCNAME, very_unlikely_RaTe);                         \
+      }                                                                        \
    }
 
 //! Log with a printf interface.
@@ -171,10 +260,13 @@ class LOGFILE_EXPORT logger {
          SuS::logfile::logger::log_level::SuS_LOG_MINLEVEL)                    \
       ;                                                                        \
    else {                                                                      \
-      SuS::logfile::logger::instance()->log(                                   \
-            SuS::logfile::logger::log_level::l, sys,                           \
-            SuS::logfile::logger::string_format(format, __VA_ARGS__),          \
-            SuS_FUNCNAME);                                                     \
+      const auto very_unlikely_LoGgEr = SuS::logfile::logger::instance();      \
+      if (const unsigned very_unlikely_RaTe = very_unlikely_LoGgEr->sample(    \
+                SuS::logfile::logger::log_level::l, sys)) {                    \
+         very_unlikely_LoGgEr->log(SuS::logfile::logger::log_level::l, sys,    \
+               SuS::logfile::logger::string_format(format, __VA_ARGS__),       \
+               SuS_FUNCNAME, very_unlikely_RaTe);                              \
+      }                                                                        \
    }
 
 //! Log with an ostringstream interface.
@@ -194,9 +286,76 @@ class LOGFILE_EXPORT logger {
          SuS::logfile::logger::log_level::SuS_LOG_MINLEVEL)                    \
       ;                                                                        \
    else {                                                                      \
-      std::ostringstream very_unlikely_NaMe;                                   \
-      very_unlikely_NaMe << msg;                                               \
-      SuS::logfile::logger::instance()->log(                                   \
-            SuS::logfile::logger::log_level::l, sys, very_unlikely_NaMe.str(), \
-            SuS_FUNCNAME);                                                     \
+      const auto very_unlikely_LoGgEr = SuS::logfile::logger::instance();      \
+      if (const unsigned very_unlikely_RaTe = very_unlikely_LoGgEr->sample(    \
+                SuS::logfile::logger::log_level::l, sys)) {                    \
+         std::ostringstream very_unlikely_NaMe;                                \
+         very_unlikely_NaMe << msg;                                            \
+         very_unlikely_LoGgEr->log(SuS::logfile::logger::log_level::l, sys,    \
+               very_unlikely_NaMe.str(), SuS_FUNCNAME, very_unlikely_RaTe);    \
+      }                                                                        \
+   }
+
+//! Log with an ostringstream interface, every _n-th time only.
+/*!
+ *  The first call logs. A throttled call costs one relaxed atomic
+ *  increment, the message is not formatted.
+ *
+ *  @param l The log level to use (member of SuS::logfile::logger::log_level).
+ *  @param sys The id of the subsystem initiating the logging.
+ *  @param n Log every n-th call of this line. 0 never logs.
+ *  @param msg The actual log message, as for \ref SuS_LOG_STREAM.
+ */
+#define SuS_LOG_EVERY_N(l, sys, n, msg)                                        \
+   if (SuS::logfile::logger::log_level::l <                                    \
+         SuS::logfile::logger::log_level::SuS_LOG_MINLEVEL)                    \
+      ;                                                                        \
+   else {                                                                      \
+      static std::atomic<unsigned long> very_unlikely_CoUnT{0U};               \
+      const unsigned long very_unlikely_N = (n);                               \
+      if ((very_unlikely_N != 0U) &&                                           \
+            (very_unlikely_CoUnT.fetch_add(1U, std::memory_order_relaxed) %    \
+                        very_unlikely_N ==                                     \
+                  0U)) {                                                       \
+         SuS_LOG_STREAM(l, sys, msg);                                          \
+      }                                                                        \
+   }
+
+//! Log with an ostringstream interface, the first _n times only.
+/*!
+ *  @param l The log level to use (member of SuS::logfile::logger::log_level).
+ *  @param sys The id of the subsystem initiating the logging.
+ *  @param n Log the first n calls of this line.
+ *  @param msg The actual log message, as for \ref SuS_LOG_STREAM.
+ */
+#define SuS_LOG_FIRST_N(l, sys, n, msg)                                        \
+   if (SuS::logfile::logger::log_level::l <                                    \
+         SuS::logfile::logger::log_level::SuS_LOG_MINLEVEL)                    \
+      ;                                                                        \
+   else {                                                                      \
+      static std::atomic<unsigned long> very_unlikely_CoUnT{0U};               \
+      /* stop counting when done, so that the counter cannot wrap. */          \
+      if ((very_unlikely_CoUnT.load(std::memory_order_relaxed) < (n)) &&       \
+            (very_unlikely_CoUnT.fetch_add(1U, std::memory_order_relaxed) <    \
+                  (n))) {                                                      \
+         SuS_LOG_STREAM(l, sys, msg);                                          \
+      }                                                                        \
+   }
+
+//! Log with an ostringstream interface, at most once per interval.
+/*!
+ *  @param l The log level to use (member of SuS::logfile::logger::log_level).
+ *  @param sys The id of the subsystem initiating the logging.
+ *  @param ms The minimum time between two messages of this line in ms.
+ *  @param msg The actual log message, as for \ref SuS_LOG_STREAM.
+ */
+#define SuS_LOG_EVERY_MS(l, sys, ms, msg)                                      \
+   if (SuS::logfile::logger::log_level::l <                                    \
+         SuS::logfile::logger::log_level::SuS_LOG_MINLEVEL)                    \
+      ;                                                                        \
+   else {                                                                      \
+      static std::atomic<long long> very_unlikely_NeXt{0};                     \
+      if (SuS::logfile::logger::interval_elapsed(very_unlikely_NeXt, (ms))) {  \
+         SuS_LOG_STREAM(l, sys, msg);                                          \
+      }                                                                        \
    }
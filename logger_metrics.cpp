@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: MIT */
+#include "logger_metrics.h"
+
+#include <iostream>
+
+namespace {
+void print_latency(std::ostream &_stream, const char *_name,
+      const SuS::logfile::logger_metrics::latency &_l) {
+   if (!_l.count)
+      return;
+   _stream << "   " << _name << " latency: p50 " << _l.p50 << " us, p99 "
+           << _l.p99 << " us, p99.9 " << _l.p999 << " us (" << _l.count
+           << " events)" << std::endl;
+}
+} // namespace
+
+void SuS::logfile::logger_metrics::print(std::ostream &_stream) const {
+   _stream << "metrics:" << std::endl
+           << "   queue depth: " << queue_depth << " (max. "
+           << max_queue_depth << ")" << std::endl;
+   print_latency(_stream, "submit", submit);
+   print_latency(_stream, "queue", queue);
+   for (const auto &i : subsystems) {
+      if (i.levels.empty())
+         continue;
+      _stream << "   - subsystem " << i.name << ":";
+      auto separator = " ";
+      for (const auto &j : i.levels) {
+         _stream << separator << logger::level_name(j.first) << " "
+                 << j.second.submitted << " submitted/" << j.second.filtered
+                 << " filtered";
+         separator = ", ";
+      }
+      _stream << std::endl;
+   }
+   for (const auto &i : sinks) {
+      _stream << "   - sink " << i.name << ": " << i.written << " written, "
+              << i.failed << " failed, " << i.retried << " retried, "
+              << i.expired << " expired, " << i.evicted << " evicted"
+              << std::endl
+              << "     retry queue: " << i.retry_queue_entries
+              << " entries, " << i.retry_queue_bytes << " bytes in memory, "
+              << i.retry_spool_bytes << " bytes spooled";
+      if (i.retry_queue_entries)
+         _stream << ", oldest " << i.oldest_retry_age << " s";
+      _stream << std::endl;
+      print_latency(_stream, "  write", i.write);
+      print_latency(_stream, "  delivery", i.delivery);
+   }
+} // logger_metrics::print
@@ -0,0 +1,88 @@
+/* SPDX-License-Identifier: MIT */
+/*! @file */
+#pragma once
+
+#include "logfile_export.h"
+#include "logger.h"
+
+#include <cstddef>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace SuS {
+namespace logfile {
+
+//! Snapshot of the counters of the logging pipeline.
+/*!
+ * Returned by logger::metrics(). The counters are taken one by one while
+ * logging goes on, so they need not add up exactly.
+ */
+struct LOGFILE_EXPORT logger_metrics {
+   //! Percentiles of a latency histogram in microseconds.
+   /*!
+    * Empty, if the library was built without LATENCY_HISTOGRAMS.
+    */
+   struct latency {
+      unsigned long long count{0U};
+      double p50{0.};
+      double p99{0.};
+      double p999{0.};
+   };
+
+   struct level_counters {
+      //! Messages queued for the log thread.
+      unsigned long long submitted{0U};
+      //! Messages dropped before: below the minimum level of the
+      //! subsystem, not sampled, or over the rate limit.
+      unsigned long long filtered{0U};
+   };
+
+   struct subsystem {
+      std::string name;
+      //! Only levels with messages are present.
+      std::map<logger::log_level, level_counters> levels;
+   };
+
+   struct sink {
+      std::string name;
+      //! Events written successfully, directly or when retried.
+      unsigned long long written{0U};
+      //! Failed writes.
+      unsigned long long failed{0U};
+      //! Events written by the retry scheduler.
+      unsigned long long retried{0U};
+      //! Events dropped from the retry queue, because they were too old.
+      unsigned long long expired{0U};
+      //! Events dropped from the retry queue, because it was full.
+      unsigned long long evicted{0U};
+      //! Events in the retry queue in memory, and their size.
+      size_t retry_queue_entries{0U};
+      size_t retry_queue_bytes{0U};
+      //! Size of the events only in the retry spool.
+      size_t retry_spool_bytes{0U};
+      //! Age of the oldest event in the retry queue in seconds.
+      long long oldest_retry_age{0};
+      //! Duration of the writes.
+      latency write;
+      //! From the call of logger::log to the successful write.
+      latency delivery;
+   };
+
+   std::vector<subsystem> subsystems;
+   //! Events waiting for the log thread.
+   size_t queue_depth{0U};
+   //! Maximum of queue_depth so far.
+   size_t max_queue_depth{0U};
+   //! Time spent in logger::log by the threads logging.
+   latency submit;
+   //! From the call of logger::log until the log thread takes the event.
+   latency queue;
+   std::vector<sink> sinks;
+
+   void print(std::ostream &_stream) const;
+}; // struct logger_metrics
+
+} // namespace logfile
+} // namespace SuS
@@ -1,18 +1,41 @@
 /* SPDX-License-Identifier: MIT */
 #pragma once
 
+#include "latency_histogram.h"
 #include "logger.h"
+#include "rate_limiter.h"
 
+#include <atomic>
 #include <map>
+#include <memory>
 
 namespace SuS {
 namespace logfile {
 
 class log_thread;
 
+//! Sampling of the low-level messages of a subsystem.
+struct sampling {
+   //! Log 1 in one_in messages. 1 logs all of them.
+   std::atomic<unsigned> one_in{1U};
+   //! The highest level sampled.
+   std::atomic<logger::log_level> max_level{logger::log_level::finest};
+};
+
+//! Counters of the messages of a subsystem, indexed by log level.
+struct subsystem_counters {
+   static const size_t s_levels = size_t(logger::log_level::severe) + 1U;
+   std::atomic<unsigned long long> submitted[s_levels];
+   std::atomic<unsigned long long> filtered[s_levels];
+};
+
 struct subsystem_info {
    std::string name;
    logger::log_level min_level;
+   //! Not a plain member: atomics cannot be moved into the map.
+   std::unique_ptr<rate_limiter> limiter;
+   std::unique_ptr<sampling> sampler;
+   std::unique_ptr<subsystem_counters> counters;
 };
 
 struct logger_private {
@@ -26,6 +49,9 @@ struct logger_private {
    logger::subsystem_t m_next_free_subsystem_id{0};
 
    log_thread *m_thread;
+
+   //! Time spent in logger::log.
+   latency_histogram m_submit_latency;
 };
 
 } // namespace logfile
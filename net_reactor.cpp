@@ -0,0 +1,237 @@
+/* SPDX-License-Identifier: MIT */
+#include "net_reactor.h"
+
+#include "config.h"
+#include "crash_log.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <stdint.h>
+#include <string.h>
+#include <system_error>
+#ifdef HAVE_PRCTL
+#include <sys/prctl.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+namespace {
+//! Limit of the threads for blocking tasks.
+const size_t s_max_blocking_threads = 4U;
+
+// same scheme as log_thread::run: the program name plus a suffix.
+void set_thread_name(const char *_suffix) {
+#if defined HAVE_PRCTL && defined PR_GET_NAME
+   char threadname[17];
+   ::prctl(PR_GET_NAME, threadname, 0, 0, 0);
+   threadname[16] = '\0';
+   ::strncat(threadname, _suffix, 16 - ::strlen(threadname));
+   ::prctl(PR_SET_NAME, threadname, 0, 0, 0);
+#else
+   (void)_suffix;
+#endif
+}
+} // namespace
+
+SuS::logfile::net_reactor *SuS::logfile::net_reactor::instance() {
+   // never deleted: sinks are destroyed from an atexit handler, which may
+   // run after static objects have been destroyed.
+   static net_reactor *s_instance = new net_reactor;
+   return s_instance;
+} // net_reactor::instance
+
+SuS::logfile::net_reactor::net_reactor() {
+   if (::pipe(m_wake_pipe) != 0) {
+      throw std::runtime_error{"Could not create the reactor wake-up pipe."};
+   }
+#ifdef HAVE_FCNTL_H
+   // a full pipe must not block wake().
+   for (const auto fd : m_wake_pipe) {
+      ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+   }
+#endif
+   m_poller.add(m_wake_pipe[0], fd_poller::readable);
+   m_thread = std::thread(&net_reactor::run, this);
+} // net_reactor constructor
+
+void SuS::logfile::net_reactor::add(
+      int _fd, unsigned _events, io_callback_t _on_ready) {
+   std::lock_guard<std::recursive_mutex> lk(m_mutex);
+   const auto id = m_next_registration++;
+   m_handlers[_fd] = registration{id, std::move(_on_ready)};
+   // the registration id is handed back with the events, so that events for
+   // an old registration of a reused descriptor can be told apart.
+   m_poller_ops.push_back([this, _fd, _events, id]() {
+      m_poller.add(_fd, _events, reinterpret_cast<void *>(uintptr_t(id)));
+   });
+   wake();
+} // net_reactor::add
+
+void SuS::logfile::net_reactor::modify(int _fd, unsigned _events) {
+   std::lock_guard<std::recursive_mutex> lk(m_mutex);
+   const auto h = m_handlers.find(_fd);
+   if (h == m_handlers.end()) {
+      return;
+   }
+   const auto id = h->second.id;
+   m_poller_ops.push_back([this, _fd, _events, id]() {
+      m_poller.modify(_fd, _events, reinterpret_cast<void *>(uintptr_t(id)));
+   });
+   if (!in_reactor_thread()) {
+      wake();
+   }
+} // net_reactor::modify
+
+void SuS::logfile::net_reactor::remove(int _fd) {
+   std::lock_guard<std::recursive_mutex> lk(m_mutex);
+   if (m_handlers.erase(_fd) == 0U) {
+      return;
+   }
+   // the descriptor might already be closed => ignore errors.
+   m_poller_ops.push_back([this, _fd]() { m_poller.remove(_fd); });
+   wake();
+} // net_reactor::remove
+
+void SuS::logfile::net_reactor::add_timer(
+      clock::time_point _when, callback_t _cb, const void *_owner) {
+   std::lock_guard<std::recursive_mutex> lk(m_mutex);
+   m_timers.emplace(
+         timer_key_t{_when, m_next_timer++}, timer{std::move(_cb), _owner});
+   if (!in_reactor_thread()) {
+      // the new timer might be due before the current wait ends.
+      wake();
+   }
+} // net_reactor::add_timer
+
+void SuS::logfile::net_reactor::cancel_timers(const void *_owner) {
+   std::lock_guard<std::recursive_mutex> lk(m_mutex);
+   for (auto i = m_timers.begin(); i != m_timers.end();) {
+      if (i->second.owner == _owner) {
+         i = m_timers.erase(i);
+      } else {
+         ++i;
+      }
+   }
+} // net_reactor::cancel_timers
+
+void SuS::logfile::net_reactor::post_blocking(
+      callback_t _task, const void *_owner) {
+   {
+      std::lock_guard<std::mutex> lk(m_blocking_mutex);
+      m_blocking_tasks.push_back(blocking_task{std::move(_task), _owner});
+      // every idle thread might already be about to take an earlier task.
+      if ((m_blocking_tasks.size() > m_blocking_idle) &&
+            (m_blocking_threads.size() < s_max_blocking_threads)) {
+         try {
+            m_blocking_threads.emplace_back(&net_reactor::run_blocking, this);
+         } catch (const std::system_error &) {
+            if (m_blocking_threads.empty()) {
+               m_blocking_tasks.pop_back();
+               throw;
+            }
+            // the running threads take the task later.
+         }
+      }
+   }
+   m_blocking_cv.notify_one();
+} // net_reactor::post_blocking
+
+bool SuS::logfile::net_reactor::cancel_blocking(const void *_owner) {
+   std::lock_guard<std::mutex> lk(m_blocking_mutex);
+   const auto end = std::remove_if(m_blocking_tasks.begin(),
+         m_blocking_tasks.end(),
+         [_owner](const blocking_task &_t) { return _t.owner == _owner; });
+   const auto ret = (end != m_blocking_tasks.end());
+   m_blocking_tasks.erase(end, m_blocking_tasks.end());
+   return ret;
+} // net_reactor::cancel_blocking
+
+bool SuS::logfile::net_reactor::in_reactor_thread() const {
+   return std::this_thread::get_id() == m_thread.get_id();
+} // net_reactor::in_reactor_thread
+
+void SuS::logfile::net_reactor::wake() {
+   const char c = 0;
+   // when the pipe is full, the reactor is going to wake up anyway.
+   if (::write(m_wake_pipe[1], &c, 1) < 0) {
+   }
+} // net_reactor::wake
+
+void SuS::logfile::net_reactor::run() {
+   crash_log::install_signal_stack();
+   set_thread_name(" (net)");
+   std::vector<fd_poller::event> events;
+   while (true) {
+      auto timeout_ms = -1;
+      {
+         std::lock_guard<std::recursive_mutex> lk(m_mutex);
+         for (const auto &op : m_poller_ops) {
+            try {
+               op();
+            } catch (const std::runtime_error &) {
+               // e.g. a descriptor that has been closed in the meantime.
+            }
+         }
+         m_poller_ops.clear();
+         if (!m_timers.empty()) {
+            const auto until = m_timers.begin()->first.first - clock::now();
+            const auto ms =
+                  std::chrono::duration_cast<std::chrono::milliseconds>(until)
+                        .count();
+            // round up, so that we do not wake up just before the timer.
+            timeout_ms = int(std::max(ms + 1, decltype(ms){0}));
+         }
+      }
+
+      m_poller.wait(events, timeout_ms);
+
+      std::lock_guard<std::recursive_mutex> lk(m_mutex);
+      for (const auto &ev : events) {
+         if (ev.fd == m_wake_pipe[0]) {
+            char buf[64];
+            while (::read(m_wake_pipe[0], buf, sizeof buf) > 0) {
+            }
+            continue;
+         }
+         // the registration might have been removed or replaced after the
+         // wait returned.
+         const auto h = m_handlers.find(ev.fd);
+         if ((h == m_handlers.end()) ||
+               (h->second.id != reinterpret_cast<uintptr_t>(ev.user))) {
+            continue;
+         }
+         // copy: the callback may remove itself.
+         const auto cb = h->second.on_ready;
+         cb(ev.events);
+      }
+
+      const auto now = clock::now();
+      while (!m_timers.empty() && (m_timers.begin()->first.first <= now)) {
+         const auto i = m_timers.begin();
+         const auto cb = std::move(i->second.cb);
+         m_timers.erase(i);
+         cb();
+      }
+   }
+} // net_reactor::run
+
+void SuS::logfile::net_reactor::run_blocking() {
+   crash_log::install_signal_stack();
+   set_thread_name(" (connect)");
+   while (true) {
+      callback_t task;
+      {
+         std::unique_lock<std::mutex> lk(m_blocking_mutex);
+         ++m_blocking_idle;
+         m_blocking_cv.wait(lk, [this]() { return !m_blocking_tasks.empty(); });
+         --m_blocking_idle;
+         task = std::move(m_blocking_tasks.front().cb);
+         m_blocking_tasks.pop_front();
+      }
+      task();
+   }
+} // net_reactor::run_blocking
@@ -0,0 +1,132 @@
+/* SPDX-License-Identifier: MIT */
+/*! @file */
+#pragma once
+
+#include "fd_poller.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace SuS {
+namespace logfile {
+
+//! The network I/O thread shared by all socket-based sinks.
+/*!
+ * Instead of every sink running its own reader and timer threads, sinks
+ * register their sockets and timers here, and a single thread waits for
+ * all of them with an \ref fd_poller and calls back into the sinks.
+ *
+ * Connection setup (DNS, TCP, SOCKS and SSL handshakes) is blocking, so it
+ * runs on a small pool of shared threads (see \ref post_blocking). They are
+ * started when needed, up to a fixed limit, so that one slow broker does
+ * not hold up the reconnects of the other sinks. The number of threads is
+ * therefore bounded, independent of the number of sinks.
+ *
+ * Callbacks are called with an internal (recursive) mutex held. After
+ * \ref remove or \ref cancel_timers returned, the respective callbacks are
+ * guaranteed not to run anymore. Callbacks must not wait for other threads
+ * that might call into the reactor.
+ */
+class net_reactor {
+ public:
+   typedef std::function<void()> callback_t;
+   //! Called with the fd_poller flags that are set.
+   typedef std::function<void(unsigned)> io_callback_t;
+   typedef std::chrono::steady_clock clock;
+
+   //! Get the process-wide instance. It is never destroyed.
+   static net_reactor *instance();
+
+   //! Call _on_ready whenever _fd is ready for one of _events.
+   /*!
+    * @param _events fd_poller::readable and/or fd_poller::writable.
+    */
+   void add(int _fd, unsigned _events, io_callback_t _on_ready);
+   //! Change the events watched for _fd. Ignored for unknown descriptors.
+   void modify(int _fd, unsigned _events);
+   //! Stop watching _fd.
+   void remove(int _fd);
+
+   //! Call _cb once at _when on the reactor thread.
+   /*!
+    * @param _owner Tag for \ref cancel_timers, usually the caller's this.
+    */
+   void add_timer(clock::time_point _when, callback_t _cb, const void *_owner);
+   //! Cancel all timers added with _owner.
+   void cancel_timers(const void *_owner);
+
+   //! Run _task on one of the shared threads for blocking operations.
+   /*!
+    * Every step of the task should have a timeout: it occupies the thread
+    * until it returns.
+    * @param _owner Tag for \ref cancel_blocking, usually the caller's this.
+    */
+   void post_blocking(callback_t _task, const void *_owner);
+   //! Drop the tasks posted with _owner that have not started yet.
+   /*!
+    * @return True, if a task was dropped.
+    */
+   bool cancel_blocking(const void *_owner);
+
+   //! Check, if the caller is the reactor thread.
+   bool in_reactor_thread() const;
+
+ private:
+   net_reactor();
+   ~net_reactor() = delete;
+
+   void run();
+   void run_blocking();
+   void wake();
+
+   fd_poller m_poller;
+   //! Self-pipe to interrupt the wait in \ref run.
+   int m_wake_pipe[2];
+
+   mutable std::recursive_mutex m_mutex;
+
+   struct registration {
+      uint_fast64_t id;
+      io_callback_t on_ready;
+   };
+   //! Registered descriptors, protected by m_mutex.
+   std::map<int, registration> m_handlers;
+   uint_fast64_t m_next_registration{1U};
+   //! Changes to m_poller, applied by the reactor thread in order.
+   std::vector<std::function<void()>> m_poller_ops;
+
+   struct timer {
+      callback_t cb;
+      const void *owner;
+   };
+   //! Pending timers by due time. The sequence number keeps timers with the
+   //! same due time in the order they were added.
+   typedef std::pair<clock::time_point, uint_fast64_t> timer_key_t;
+   std::map<timer_key_t, timer> m_timers;
+   uint_fast64_t m_next_timer{0U};
+
+   struct blocking_task {
+      callback_t cb;
+      const void *owner;
+   };
+   std::mutex m_blocking_mutex;
+   std::condition_variable m_blocking_cv;
+   std::deque<blocking_task> m_blocking_tasks;
+   //! Threads waiting for a task, protected by m_blocking_mutex.
+   size_t m_blocking_idle{0U};
+
+   std::thread m_thread;
+   //! Started by post_blocking(), protected by m_blocking_mutex.
+   std::vector<std::thread> m_blocking_threads;
+}; // class net_reactor
+
+} // namespace logfile
+} // namespace SuS
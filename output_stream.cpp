@@ -1,13 +1,28 @@
 /* SPDX-License-Identifier: MIT */
 #include "output_stream.h"
 
+#include "config.h"
 #include "log_event.h"
 #include "output_stream_private.h"
 
 #include <iostream>
+#include <limits>
 
 SuS::logfile::output_stream::output_stream() : m_d{new output_stream_private} {
    m_d->m_minLogLevel = SuS::logfile::logger::log_level::SuS_LOG_MINLEVEL;
+   // default expiry times for the different log levels in seconds. not a
+   // static table: the stdout stream is created during static
+   // initialization.
+   m_d->m_retry_expiry = {
+         {SuS::logfile::logger::log_level::finest, 900},
+         {SuS::logfile::logger::log_level::finer, 900},
+         {SuS::logfile::logger::log_level::fine, 1800},
+         {SuS::logfile::logger::log_level::config, 1800},
+         {SuS::logfile::logger::log_level::info, 3600},
+         {SuS::logfile::logger::log_level::warning, 10 * 3600},
+         {SuS::logfile::logger::log_level::severe,
+               std::numeric_limits<std::time_t>::max()},
+   };
 } // output_stream::constructor
 
 SuS::logfile::output_stream::~output_stream() {
@@ -17,6 +32,25 @@ void SuS::logfile::output_stream::dump(std::ostream &_stream) {
    _stream << "   - " << name() << std::endl
            << "     min. log level: "
            << SuS::logfile::logger::level_name(m_d->m_minLogLevel) << std::endl;
+   if (!m_d->m_spool_path.empty())
+      _stream << "     retry spool: " << m_d->m_spool_path << " ("
+              << m_d->m_spool_memory_limit << " bytes in memory)" << std::endl;
+   _stream << "     retry memory limit: ";
+   if (m_d->m_retry_memory_limit)
+      _stream << m_d->m_retry_memory_limit << " bytes" << std::endl;
+   else
+      _stream << "none" << std::endl;
+   _stream << "     retry expiry:";
+   auto separator = " ";
+   for (const auto &i : m_d->m_retry_expiry) {
+      _stream << separator << SuS::logfile::logger::level_name(i.first) << " ";
+      separator = ", ";
+      if (i.second == std::numeric_limits<std::time_t>::max())
+         _stream << "never";
+      else
+         _stream << i.second << " s";
+   }
+   _stream << std::endl;
 }
 
 unsigned SuS::logfile::output_stream::retry_time() {
@@ -27,8 +61,51 @@ void SuS::logfile::output_stream::set_min_log_level(logger::log_level _level) {
    m_d->m_minLogLevel = _level;
 }
 
+void SuS::logfile::output_stream::set_retry_spool(
+      const std::string &_path, size_t _memory_limit) {
+   m_d->m_spool_path = _path;
+   m_d->m_spool_memory_limit = _memory_limit;
+} // output_stream::set_retry_spool
+
+void SuS::logfile::output_stream::set_retry_memory_limit(size_t _bytes) {
+   m_d->m_retry_memory_limit = _bytes;
+} // output_stream::set_retry_memory_limit
+
+void SuS::logfile::output_stream::set_retry_expiry(
+      logger::log_level _level, unsigned _seconds) {
+   m_d->m_retry_expiry[_level] = std::time_t(_seconds);
+} // output_stream::set_retry_expiry
+
 bool SuS::logfile::output_stream::write(const log_event &_le) {
    if (_le.level < m_d->m_minLogLevel)
       return true /* no error */;
-   return do_write(_le);
+#ifdef LATENCY_HISTOGRAMS
+   const auto start = latency_histogram::clock::now();
+   const auto ok = do_write(_le);
+   const auto end = latency_histogram::clock::now();
+   m_d->m_write_latency.record(end - start);
+   // a failed write is not a delivery. it is retried, and counted then.
+   if (ok)
+      m_d->m_delivery_latency.record(end - _le.submit_time);
+#else
+   const auto ok = do_write(_le);
+#endif
+   // only written from one thread at a time => relaxed is enough.
+   (ok ? m_d->m_written : m_d->m_failed)
+         .fetch_add(1U, std::memory_order_relaxed);
+   return ok;
 }
+
+unsigned long long SuS::logfile::output_stream::written() const {
+   return m_d->m_written.load(std::memory_order_relaxed);
+} // output_stream::written
+
+unsigned long long SuS::logfile::output_stream::failed() const {
+   return m_d->m_failed.load(std::memory_order_relaxed);
+} // output_stream::failed
+
+void SuS::logfile::output_stream::get_latency(
+      logger_metrics::sink &_metrics) const {
+   m_d->m_write_latency.get(_metrics.write);
+   m_d->m_delivery_latency.get(_metrics.delivery);
+} // output_stream::get_latency
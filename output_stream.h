@@ -2,6 +2,7 @@
 #pragma once
 
 #include "logger.h"
+#include "logger_metrics.h"
 
 #include <iosfwd>
 #include <memory>
@@ -26,12 +27,47 @@ class LOGFILE_EXPORT output_stream {
 
    virtual void set_min_log_level(logger::log_level _level);
 
+   //! Keep the retry queue of this sink in a file.
+   /*!
+    * Events waiting for the sink survive a crash or restart then, and only
+    * up to _memory_limit bytes of them are kept in memory.
+    *
+    * Call this before passing the sink to logger::add_output_stream: that
+    * is when events left over from an earlier run are picked up.
+    */
+   void set_retry_spool(
+         const std::string &_path, size_t _memory_limit = 1024U * 1024U);
+
+   //! Limit the memory taken by events waiting for a retry.
+   /*!
+    * Above the limit, events are dropped: those of the lowest level first,
+    * and of them the oldest. 0 means no limit. The default is 16 MiB.
+    * For a sink with a retry spool, the memory is limited by the spool
+    * settings instead. Then this only limits the events that could not be
+    * written to the spool, or are still waiting to be written to it, and
+    * new ones are dropped above it.
+    */
+   void set_retry_memory_limit(size_t _bytes);
+
+   //! Drop events of _level waiting for a retry after _seconds.
+   void set_retry_expiry(logger::log_level _level, unsigned _seconds);
+
    bool write(const log_event &_le);
 
+   //! Number of events written successfully.
+   unsigned long long written() const;
+   //! Number of failed writes.
+   unsigned long long failed() const;
+
+   //! Fill in the write and delivery latencies.
+   void get_latency(logger_metrics::sink &_metrics) const;
+
  private:
    virtual bool do_write(const log_event &_le) = 0;
 
    std::unique_ptr<output_stream_private> m_d;
+
+   friend class retry_scheduler;
 }; // class output_stream
 
 } // namespace logfile
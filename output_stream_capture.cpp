@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: MIT */
+#include "output_stream_capture.h"
+
+#include <algorithm>
+#include <ostream>
+#include <stdexcept>
+
+SuS::logfile::output_stream_capture::output_stream_capture(
+      size_t _capacity, const std::string &_name)
+   : output_stream(), m_name(_name.empty() ? "capture" : _name) {
+   if (!_capacity) {
+      throw std::invalid_argument{"The capacity of a capture sink must not "
+                                  "be 0."};
+   }
+   m_ring.resize(_capacity);
+} // output_stream_capture constructor
+
+void SuS::logfile::output_stream_capture::dump(std::ostream &_stream) {
+   output_stream::dump(_stream);
+   std::lock_guard<std::mutex> lk(m_mutex);
+   _stream << "     capacity: " << m_ring.size() << " events ("
+           << std::min<unsigned long long>(m_count, m_ring.size())
+           << " captured)" << std::endl;
+} // output_stream_capture::dump
+
+std::string SuS::logfile::output_stream_capture::name() {
+   return m_name;
+} // output_stream_capture::name
+
+size_t SuS::logfile::output_stream_capture::capacity() const {
+   return m_ring.size();
+} // output_stream_capture::capacity
+
+std::vector<SuS::logfile::log_event>
+SuS::logfile::output_stream_capture::events() const {
+   std::lock_guard<std::mutex> lk(m_mutex);
+   std::vector<log_event> ret;
+   const auto size = m_ring.size();
+   const auto first = m_count > size ? m_count - size : 0U;
+   ret.reserve(size_t(m_count - first));
+   for (auto i = first; i < m_count; ++i) {
+      ret.push_back(m_ring[size_t(i % size)]);
+   }
+   return ret;
+} // output_stream_capture::events
+
+unsigned long long SuS::logfile::output_stream_capture::dropped() const {
+   std::lock_guard<std::mutex> lk(m_mutex);
+   return m_count > m_ring.size() ? m_count - m_ring.size() : 0U;
+} // output_stream_capture::dropped
+
+void SuS::logfile::output_stream_capture::clear() {
+   std::lock_guard<std::mutex> lk(m_mutex);
+   m_count = 0U;
+} // output_stream_capture::clear
+
+bool SuS::logfile::output_stream_capture::wait(
+      unsigned long long _count, std::chrono::milliseconds _timeout) {
+   std::unique_lock<std::mutex> lk(m_mutex);
+   return m_cv.wait_for(lk, _timeout, [&]() { return m_count >= _count; });
+} // output_stream_capture::wait
+
+bool SuS::logfile::output_stream_capture::do_write(const log_event &_le) {
+   {
+      std::lock_guard<std::mutex> lk(m_mutex);
+      // assign instead of replacing the slot, to reuse its strings.
+      auto &slot = m_ring[size_t(m_count % m_ring.size())];
+      slot.level = _le.level;
+      slot.subsystem = _le.subsystem;
+      slot.message.assign(_le.message);
+      slot.time = _le.time;
+      slot.function.assign(_le.function);
+      slot.subsystem_string.assign(_le.subsystem_string);
+      slot.time_string.assign(_le.time_string);
+      slot.sample_rate = _le.sample_rate;
+      slot.submit_time = _le.submit_time;
+      ++m_count;
+   }
+   m_cv.notify_all();
+   return true;
+} // output_stream_capture::do_write
@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: MIT */
+#pragma once
+
+#include "log_event.h"
+#include "logfile_export.h"
+#include "output_stream.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace SuS {
+namespace logfile {
+
+//! Sink keeping the last events in memory, e.g. for checks in tests.
+/*!
+ * The events are stored in a ring of \ref capacity slots, allocated when
+ * the sink is created. When the ring is full, the oldest event is
+ * overwritten. The slots keep the memory of their strings, so once every
+ * slot has been used, writing allocates only for longer messages.
+ *
+ * All functions are thread-safe.
+ */
+class LOGFILE_EXPORT output_stream_capture : public output_stream {
+ public:
+   explicit output_stream_capture(
+         size_t _capacity = 1024U, const std::string &_name = "");
+
+   virtual void dump(std::ostream &_stream) override;
+
+   virtual std::string name() override;
+
+   size_t capacity() const;
+
+   //! The events captured, oldest first.
+   std::vector<log_event> events() const;
+
+   //! Number of events overwritten, because the ring was full.
+   unsigned long long dropped() const;
+
+   //! Forget all events captured.
+   void clear();
+
+   //! Wait until _count events have been captured since the last clear().
+   /*!
+    * Overwritten events count as well.
+    * @return False on timeout.
+    */
+   bool wait(unsigned long long _count, std::chrono::milliseconds _timeout);
+
+ private:
+   virtual bool do_write(const log_event &_le) override;
+
+   const std::string m_name;
+   mutable std::mutex m_mutex;
+   std::condition_variable m_cv;
+   std::vector<log_event> m_ring;
+   //! Events captured since the last clear(). The next one goes to
+   //! m_ring[m_count % m_ring.size()].
+   unsigned long long m_count{0U};
+}; // class output_stream_capture
+
+} // namespace logfile
+} // namespace SuS
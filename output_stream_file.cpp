@@ -38,7 +38,10 @@ bool SuS::logfile::output_stream_file::do_write(const log_event &_le) {
 
    std::ostringstream ss;
    ss << "<message level=\"" << SuS::logfile::logger::level_name(_le.level)
-      << "\"><time>" << _le.time_string << "</time><subsystem>"
+      << "\"";
+   if (_le.sample_rate > 1U)
+      ss << " sample-rate=\"" << _le.sample_rate << "\"";
+   ss << "><time>" << _le.time_string << "</time><subsystem>"
       << _le.subsystem_string << "</subsystem><function>" << _le.function
       << "</function><text>" << formatCData(_le.message) << "</text></message>"
       << std::endl;
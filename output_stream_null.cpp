@@ -0,0 +1,21 @@
+/* SPDX-License-Identifier: MIT */
+#include "output_stream_null.h"
+#include "log_event.h"
+
+SuS::logfile::output_stream_null::output_stream_null(const std::string &_name)
+   : output_stream(), m_name(_name.empty() ? "null" : _name) {
+} // output_stream_null constructor
+
+std::string SuS::logfile::output_stream_null::name() {
+   return m_name;
+} // output_stream_null::name
+
+unsigned long long SuS::logfile::output_stream_null::bytes() const {
+   return m_bytes.load(std::memory_order_relaxed);
+} // output_stream_null::bytes
+
+bool SuS::logfile::output_stream_null::do_write(const log_event &_le) {
+   // only written from one thread at a time => relaxed is enough.
+   m_bytes.fetch_add(_le.message.size(), std::memory_order_relaxed);
+   return true;
+} // output_stream_null::do_write
@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: MIT */
+#pragma once
+
+#include "logfile_export.h"
+#include "output_stream.h"
+
+#include <atomic>
+#include <string>
+
+namespace SuS {
+namespace logfile {
+
+//! Sink throwing every event away.
+/*!
+ * Costs next to nothing, so that the overhead of the logger and the log
+ * thread can be measured without any I/O. The events are counted by
+ * output_stream::written(), the bytes of their messages by \ref bytes.
+ */
+class LOGFILE_EXPORT output_stream_null : public output_stream {
+ public:
+   explicit output_stream_null(const std::string &_name = "");
+
+   virtual std::string name() override;
+
+   //! Total size of the messages of the events written.
+   unsigned long long bytes() const;
+
+ private:
+   virtual bool do_write(const log_event &_le) override;
+
+   const std::string m_name;
+   std::atomic<unsigned long long> m_bytes{0U};
+}; // class output_stream_null
+
+} // namespace logfile
+} // namespace SuS
@@ -1,13 +1,35 @@
 /* SPDX-License-Identifier: MIT */
 #pragma once
 
+#include "latency_histogram.h"
 #include "logger.h"
 
+#include <atomic>
+#include <ctime>
+#include <map>
+#include <string>
+
 namespace SuS {
 namespace logfile {
 
 struct output_stream_private {
    logger::log_level m_minLogLevel;
+   //! Retry spool file. Empty, if the retry queue is kept in memory.
+   std::string m_spool_path;
+   size_t m_spool_memory_limit{0U};
+   //! Upper limit for the retry queue in memory. 0 means no limit.
+   size_t m_retry_memory_limit{16U * 1024U * 1024U};
+   //! For every log level, when events waiting for a retry expire.
+   std::map<logger::log_level, std::time_t> m_retry_expiry;
+   //! Set while the retry_scheduler queues the events of the sink. Lets the
+   //! log thread skip the scheduler's lock while the sink is fine.
+   std::atomic<bool> m_retrying{false};
+   //! Successful and failed calls of do_write.
+   std::atomic<unsigned long long> m_written{0U};
+   std::atomic<unsigned long long> m_failed{0U};
+   //! Duration of do_write, and the time from logger::log until then.
+   latency_histogram m_write_latency;
+   latency_histogram m_delivery_latency;
 }; // struct output_stream_private
 
 } // namespace logfile
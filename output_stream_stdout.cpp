@@ -4,7 +4,6 @@
 
 #include <iomanip>
 #include <iostream>
-#include <map>
 #include <sstream>
 #include <stdlib.h>
 
@@ -15,32 +14,38 @@
 #ifdef SuS_HAS_COLOR
 #define COLOR_ENTIRE_LINE
 namespace {
-const std::map<SuS::logfile::logger::log_level, const char *> s_colors = {
-      {SuS::logfile::logger::log_level::finest, "\033[37m"},
-      {SuS::logfile::logger::log_level::finer, "\033[37m"},
-      {SuS::logfile::logger::log_level::fine, ""},
-      {SuS::logfile::logger::log_level::config, "\033[32m"},
-      {SuS::logfile::logger::log_level::info, "\033[33m"},
-      {SuS::logfile::logger::log_level::warning, "\033[31m"},
-      {SuS::logfile::logger::log_level::severe, "\033[1;31m"}};
+// indexed by log level. plain arrays: events are still written from the
+// atexit handler, possibly after the static objects of this file have been
+// destroyed.
+const char *const s_colors[] = {
+      "\033[37m",   // finest
+      "\033[37m",   // finer
+      "",           // fine
+      "\033[32m",   // config
+      "\033[33m",   // info
+      "\033[31m",   // warning
+      "\033[1;31m", // severe
+};
 
-const std::map<SuS::logfile::logger::log_level, const char *> s_colors256dark =
-      {{SuS::logfile::logger::log_level::finest, "\033[38;5;240m"},
-            {SuS::logfile::logger::log_level::finer, "\033[38;5;244m"},
-            {SuS::logfile::logger::log_level::fine, "\033[38;5;248m"},
-            {SuS::logfile::logger::log_level::config, "\033[32m"},
-            {SuS::logfile::logger::log_level::info, "\033[33m"},
-            {SuS::logfile::logger::log_level::warning, "\033[31m"},
-            {SuS::logfile::logger::log_level::severe, "\033[1;31m"}};
+const char *const s_colors256dark[] = {
+      "\033[38;5;240m", // finest
+      "\033[38;5;244m", // finer
+      "\033[38;5;248m", // fine
+      "\033[32m",       // config
+      "\033[33m",       // info
+      "\033[31m",       // warning
+      "\033[1;31m",     // severe
+};
 
-const std::map<SuS::logfile::logger::log_level, const char *> s_colors256light =
-      {{SuS::logfile::logger::log_level::finest, "\033[38;5;248m"},
-            {SuS::logfile::logger::log_level::finer, "\033[38;5;244m"},
-            {SuS::logfile::logger::log_level::fine, "\033[38;5;240m"},
-            {SuS::logfile::logger::log_level::config, "\033[32m"},
-            {SuS::logfile::logger::log_level::info, "\033[33m"},
-            {SuS::logfile::logger::log_level::warning, "\033[31m"},
-            {SuS::logfile::logger::log_level::severe, "\033[1;31m"}};
+const char *const s_colors256light[] = {
+      "\033[38;5;248m", // finest
+      "\033[38;5;244m", // finer
+      "\033[38;5;240m", // fine
+      "\033[32m",       // config
+      "\033[33m",       // info
+      "\033[31m",       // warning
+      "\033[1;31m",     // severe
+};
 }
 #endif
 
@@ -53,7 +58,7 @@ SuS::logfile::output_stream_stdout::output_stream_stdout(
 
 void SuS::logfile::output_stream_stdout::init_colors() {
 #ifdef SuS_HAS_COLOR
-   m_colors = &s_colors;
+   m_colors = s_colors;
    // special colors on 256-color terminals
    const char *const term = ::getenv("TERM");
    if (nullptr == term) {
@@ -66,7 +71,7 @@ void SuS::logfile::output_stream_stdout::init_colors() {
       return;
    }
 
-   m_colors = &s_colors256dark;
+   m_colors = s_colors256dark;
    const char *const colorfgbg = ::getenv("COLORFGBG");
    if (nullptr == colorfgbg) {
       return;
@@ -97,7 +102,7 @@ void SuS::logfile::output_stream_stdout::init_colors() {
          return;
       }
       if (color_bg == 7 || color_bg > 9) {
-         m_colors = &s_colors256light;
+         m_colors = s_colors256light;
       }
    } catch (std::invalid_argument &) {
       // invalid env. variable => ignore
@@ -119,18 +124,21 @@ bool SuS::logfile::output_stream_stdout::do_write(const log_event &_le) {
    std::stringstream s;
    s
 #if defined SuS_HAS_COLOR && defined COLOR_ENTIRE_LINE
-         << m_colors->at(_le.level)
+         << m_colors[size_t(_le.level)]
 #endif
          << _le.time_string << " ["
 #if defined SuS_HAS_COLOR && !defined COLOR_ENTIRE_LINE
-         << m_colors->at(_le.level)
+         << m_colors[size_t(_le.level)]
 #endif
          << std::setw(7) << std::left
          << SuS::logfile::logger::level_name(_le.level)
 #if defined SuS_HAS_COLOR && !defined COLOR_ENTIRE_LINE
          << "\033[0m"
 #endif
-         << "] [" << subsystem << "] " << _le.message
+         << "] [" << subsystem << "] ";
+   if (_le.sample_rate > 1U)
+      s << "[1/" << _le.sample_rate << "] ";
+   s << _le.message
 #if defined SuS_HAS_COLOR && defined COLOR_ENTIRE_LINE
          << "\033[0m"
 #endif
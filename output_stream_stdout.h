@@ -5,7 +5,6 @@
 #include "logfile_export.h"
 
 #include <iostream>
-#include <map>
 #include <string>
 
 namespace SuS {
@@ -22,7 +21,8 @@ class LOGFILE_EXPORT output_stream_stdout : public output_stream {
 
  private:
    void init_colors();
-   const std::map<SuS::logfile::logger::log_level, const char *> *m_colors;
+   //! Escape sequences, indexed by log level.
+   const char *const *m_colors;
    const std::string m_name;
    std::ostream &m_stream;
 }; // class output_stream_stdout
@@ -2,7 +2,9 @@
 #include "output_stream_stomp.h"
 #include "line_splitter.h"
 #include "log_event.h"
+#include "net_reactor.h"
 #include "parse_url.h"
+#include "stomp_frame_parser.h"
 #include "subsystem_registrator.h"
 #include "tcp_client_socket.h"
 
@@ -10,6 +12,7 @@
 
 #include <sstream>
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <chrono>
@@ -21,38 +24,70 @@
 #endif
 #include <stdexcept>
 #include <string.h>
-#include <thread>
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
 
 namespace {
 SuS::logfile::subsystem_registrator log_id{"stomp"};
-}
+
+// heart-beat intervals offered in the CONNECT frame in ms.
+// outgoing: the smallest interval we can guarantee to send heart-beats.
+const long s_heartbeat_send_ms = 5000;
+// incoming: the interval in which we would like to receive heart-beats.
+const long s_heartbeat_receive_ms = 5000;
+} // namespace
 
 SuS::logfile::output_stream_stomp::output_stream_stomp(
       const std::string &_app_name, const std::string &_URL)
+   : output_stream_stomp(_app_name, split_URL_list(_URL)) {
+}
+
+SuS::logfile::output_stream_stomp::output_stream_stomp(
+      const std::string &_app_name, const std::vector<std::string> &_URLs)
    : output_stream(), m_app_name(sanitize_string(_app_name)),
-     m_stomp_URL{new URL_info}, m_heartbeat_thread(nullptr) {
-   // set defaults
-   m_stomp_URL->protocol = "stomp";
-   m_stomp_URL->port = 61613U;
-   m_stomp_URL->path = "LOG";
-   parse_URL(_URL, *m_stomp_URL);
-   m_socket.reset(new tcp_client_socket{m_stomp_URL->host, m_stomp_URL->port});
-   if (m_stomp_URL->protocol == "stomp") {
-      // ok
-#ifdef OPENSSL_FOUND
-   } else if (m_stomp_URL->protocol == "stomp+ssl") {
-      m_socket->use_SSL(true);
-   } else {
-      throw std::invalid_argument{"Only stomp and stomp+ssl protocols are supported."};
-   }
-#else
-   } else {
-      throw std::invalid_argument{"Only stomp protocol is supported."};
+     m_parser{new stomp_frame_parser{
+           [this](const stomp_frame &_f) { return handle_reply(_f); }}},
+     m_reply_queue{new std::deque<stomp_frame>} {
+   if (_URLs.empty()) {
+      throw std::invalid_argument{"No STOMP server given."};
    }
+   for (const auto &url : _URLs) {
+      std::unique_ptr<URL_info> info{new URL_info};
+      // set defaults
+      info->protocol = "stomp";
+      info->port = 61613U;
+      info->path = "LOG";
+      parse_URL(url, *info);
+      std::unique_ptr<tcp_client_socket> socket{
+            new tcp_client_socket{info->host, info->port}};
+      if (info->protocol == "stomp") {
+         // ok
+#ifdef HAVE_SYS_UN_H
+      } else if (info->protocol == "stomp+unix") {
+         // e.g. a broker or relay on the same host.
+         socket->use_unix_socket(info->socket_path);
+#endif
+#ifdef OPENSSL_FOUND
+      } else if (info->protocol == "stomp+ssl") {
+         socket->use_SSL(true);
+#endif
+      } else {
+         throw std::invalid_argument{"Unsupported protocol: " +
+               info->protocol + ". Supported are stomp"
+#ifdef HAVE_SYS_UN_H
+                                    ", stomp+unix"
+#endif
+#ifdef OPENSSL_FOUND
+                                    ", stomp+ssl"
 #endif
+                                    "."};
+      }
+      m_brokers.push_back(std::move(info));
+      m_sockets.push_back(std::move(socket));
+   }
+   m_stomp_URL = m_brokers.front().get();
+   m_socket = m_sockets.front().get();
 
 #if defined HOST_NAME_MAX
    char hostname[HOST_NAME_MAX + 1];
@@ -99,32 +134,140 @@ SuS::logfile::output_stream_stomp::output_stream_stomp(
       }
       m_level_strings.emplace(i, ::strdup(out.c_str()));
    }
+
+   // prerender the parts of the SEND frame that are constant for the
+   // lifetime of this sink. the header depends on the broker and is
+   // rendered in connect_to_broker().
+   m_body_createtime = "<map>\n"
+                       "<entry><string>APPLICATION-ID</string><string>" +
+         m_app_name +
+         "</string></entry>\n"
+         "<entry><string>CREATETIME</string><string>";
+   m_body_name = "</string></entry>\n"
+                 "<entry><string>HOST</string><string>" +
+         m_host +
+         "</string></entry>\n"
+         "<entry><string>NAME</string><string>";
+   m_body_severity = "</string></entry>\n"
+                     "<entry><string>SEVERITY</string><string>";
+   m_body_text = "</string></entry>\n"
+                 "<entry><string>TEXT</string><string>";
+   m_body_class = "</string></entry>\n"
+                  "<entry><string>TYPE</string><string>log</string></entry>\n"
+                  "<entry><string>USER</string><string>" +
+         m_user +
+         "</string></entry>\n"
+         "<entry><string>CLASS</string><string>";
+   m_body_end = "</string></entry>\n"
+                "</map>\n";
+   // typical frames are well below this, so usually no reallocation is
+   // needed at all.
+   m_frame.reserve(4096);
+
    connect();
 }
 
 SuS::logfile::output_stream_stomp::~output_stream_stomp() {
+   // a connection attempt on the net_reactor still uses this object.
+   // m_closing makes it give up after the current step, and every step has
+   // a timeout.
+   m_closing = true;
+   {
+      std::lock_guard<std::mutex> lk(m_connect_mutex);
+      if (net_reactor::instance()->cancel_blocking(this)) {
+         // it had not started yet.
+         m_connect_pending = false;
+      }
+   }
+   {
+      // end the wait for CONNECTED in connect_to_broker().
+      std::lock_guard<std::mutex> lk(m_reply_mutex);
+   }
+   m_reply_cv.notify_all();
+   {
+      std::unique_lock<std::mutex> lk(m_connect_mutex);
+      m_connect_cv.wait(lk, [this]() { return !m_connect_pending; });
+   }
+   disconnect();
+   // stale heart-beat timers of old connections.
+   net_reactor::instance()->cancel_timers(this);
    for (const auto &i : m_level_strings) {
       ::free(const_cast<void *>(static_cast<const void *>(i.second)));
    }
 }
 
 void SuS::logfile::output_stream_stomp::connect_thread() {
+   // try the brokers in the configured order and take the first one that
+   // accepts the connection.
+   auto connected = false;
+   for (size_t i = 0U; (i < m_brokers.size()) && !m_closing; ++i) {
+      if (connect_to_broker(i)) {
+         connected = true;
+         break;
+      }
+   }
+   if (connected) {
+      m_failed_rounds = 0U;
+      m_connected = true;
+   } else {
+      ++m_failed_rounds;
+   }
+   {
+      std::lock_guard<std::mutex> lk(m_connect_mutex);
+      m_connect_pending = false;
+   }
+   m_connect_cv.notify_all();
+}
+
+bool SuS::logfile::output_stream_stomp::connect_to_broker(size_t _index) {
+   {
+      std::lock_guard<std::mutex> lk(m_io_mutex);
+      m_stomp_URL = m_brokers[_index].get();
+      m_socket = m_sockets[_index].get();
+   }
+   {
+      // drop stale replies from a previous connection, and wait for the
+      // CONNECTED frame.
+      std::lock_guard<std::mutex> lk(m_reply_mutex);
+      m_reply_queue->clear();
+      m_reply_expected = true;
+      m_reply_receipt = 0U;
+   }
    try {
       m_socket->connect();
    } catch (const std::exception &e) {
       SuS_LOG_STREAM(warning, log_id(), "Connection failed: " << e.what());
-      m_connect_thread_done = true;
-      return;
+      return false;
    }
 
-   // outgoing: no heartbeat
-   // incoming: 5000ms heartbeat
+   // from now on, everything received is handled by on_socket_ready().
+   const auto reactor = net_reactor::instance();
+   unsigned long connection;
+   {
+      std::lock_guard<std::mutex> lk(m_io_mutex);
+      m_parser->reset();
+      m_out.clear();
+      m_last_read = m_last_write = std::chrono::steady_clock::now();
+#ifdef AMQ_4710_workaround
+      m_last_was_data = false;
+#endif
+      connection = m_connection;
+      m_fd = m_socket->handle();
+      m_registered = true;
+   }
+   reactor->add(m_fd, fd_poller::readable, [this, connection](unsigned _ev) {
+      on_socket_ready(connection, _ev);
+   });
+
    std::ostringstream s;
    s << "CONNECT\n"
-        "accept-version:1.1\n"
-        "heart-beat:0,5000\n"
+        "accept-version:1.1,1.2\n"
+        "heart-beat:"
+     << s_heartbeat_send_ms << "," << s_heartbeat_receive_ms
+     << "\n"
         "host:"
-     << m_stomp_URL->host << "\n";
+     << (m_stomp_URL->host.empty() ? "localhost" : m_stomp_URL->host)
+     << "\n";
    if (!m_stomp_URL->login.empty()) {
       s << "login:" << m_stomp_URL->login << "\n"
                                              "passcode:"
@@ -133,312 +276,512 @@ void SuS::logfile::output_stream_stomp::connect_thread() {
    s << "\n";
    const auto packet = s.str() += '\0'; // this is a real 0-byte to be sent
    try {
-      m_socket->write((const uint8_t *)(packet.c_str()), packet.length());
+      send(packet.data(), packet.length());
    } catch (const std::exception &) {
       disconnect();
-      m_connect_thread_done = true;
-      return;
+      return false;
    }
 
-   m_heartbeat_thread =
-         new std::thread{&output_stream_stomp::reader_thread, this};
-
    std::unique_lock<std::mutex> lk(m_reply_mutex);
-   if (!m_reply_queue.size()) {
-      // there is a tiny chance that the reply might have been received in the
-      // meantime.
-      const auto stat = m_reply_cv.wait_for(lk, std::chrono::seconds(5));
-      if (stat == std::cv_status::timeout) {
+   if (!m_reply_cv.wait_for(lk, std::chrono::seconds(5), [this]() {
+          return !m_reply_queue->empty() || m_closing;
+       }) ||
+         m_reply_queue->empty()) {
+      m_reply_expected = false;
+      // disconnect() waits for the reactor, which might be waiting for
+      // m_reply_mutex in handle_reply().
+      lk.unlock();
+      if (!m_closing) {
          SuS_LOG(warning, log_id(), "STOMP timeout");
-         disconnect();
-         m_connect_thread_done = true;
-         return;
       }
+      disconnect();
+      return false;
    }
-   const auto reply = m_reply_queue.front();
-   m_reply_queue.pop_front();
+   const auto reply = m_reply_queue->front();
+   m_reply_queue->pop_front();
+   lk.unlock();
    if ((reply.command != "CONNECTED") || (!check_server_version(reply)) ||
          (!parse_heartbeat(reply))) {
       disconnect();
-      m_connect_thread_done = true;
-      return;
+      return false;
    }
-   m_connected = true;
-   m_connect_thread_done = true;
-   return;
-}
+
+   // any frame counts as a heart-beat, so the timers check the time of the
+   // last write/read when they expire and reschedule themselves.
+   const auto now = std::chrono::steady_clock::now();
+   if (m_heartbeat_send_interval) {
+      reactor->add_timer(
+            now + std::chrono::milliseconds(m_heartbeat_send_interval),
+            [this, connection]() { send_heartbeat(connection); }, this);
+   }
+   if (m_heartbeat_interval) {
+      reactor->add_timer(
+            now + std::chrono::milliseconds(m_heartbeat_interval),
+            [this, connection]() { check_heartbeat(connection); }, this);
+   }
+
+   // the SEND header only depends on the broker and the protocol version.
+   m_send_prefix = "SEND\n"
+                   "destination:/topic/" +
+         encode_header(
+               m_stomp_URL->path, reply.headers.at("version") == "1.2") +
+         "\n"
+         "transformation:jms-map-xml\n";
+   return true;
+} // output_stream_stomp::connect_to_broker
 
 void SuS::logfile::output_stream_stomp::disconnect() {
-   m_socket->disconnect();
-   m_connected = false;
+   unsigned long connection;
+   {
+      std::lock_guard<std::mutex> lk(m_io_mutex);
+      connection = m_connection;
+   }
+   disconnect(connection);
+}
+
+void SuS::logfile::output_stream_stomp::disconnect(
+      unsigned long _connection) {
+   bool registered;
+   {
+      std::lock_guard<std::mutex> lk(m_io_mutex);
+      if (_connection != m_connection) {
+         // already closed by another thread.
+         return;
+      }
+      // callbacks for this connection that are already due do nothing now.
+      ++m_connection;
+      registered = m_registered;
+      m_registered = false;
+   }
+   if (registered) {
+      // waits for a running on_socket_ready(). must not hold m_io_mutex.
+      net_reactor::instance()->remove(m_fd);
+   }
+   {
+      std::lock_guard<std::mutex> lk(m_io_mutex);
+      m_socket->disconnect();
+      m_out.clear();
+   }
+   {
+      // wake up do_write() waiting for a reply.
+      std::lock_guard<std::mutex> lk(m_reply_mutex);
+      m_connected = false;
+   }
+   m_reply_cv.notify_all();
 }
 
+void SuS::logfile::output_stream_stomp::send(const char *_data, size_t _len) {
+   bool pending;
+   {
+      std::lock_guard<std::mutex> lk(m_io_mutex);
+      if (!m_registered) {
+         throw std::runtime_error{"Not connected."};
+      }
+      pending = send_locked(_data, _len);
+   }
+   if (pending) {
+      // let the reactor write the rest. the reactor lock must not be taken
+      // with m_io_mutex held.
+      net_reactor::instance()->modify(
+            m_fd, fd_poller::readable | fd_poller::writable);
+   }
+}
+
+bool SuS::logfile::output_stream_stomp::send_locked(
+      const char *_data, size_t _len) {
+   m_last_write = std::chrono::steady_clock::now();
+   if (m_out.empty()) {
+      // usual case: the socket takes everything => no copy.
+      const auto written = m_socket->write_some(
+            reinterpret_cast<const uint8_t *>(_data), unsigned(_len));
+      _data += written;
+      _len -= written;
+   }
+   m_out.append(_data, _len);
+   return !flush();
+}
+
+bool SuS::logfile::output_stream_stomp::flush() {
+   while (!m_out.empty()) {
+      const auto written = m_socket->write_some(
+            reinterpret_cast<const uint8_t *>(m_out.data()),
+            unsigned(m_out.size()));
+      if (!written) {
+         return false;
+      }
+      m_out.erase(0U, written);
+   }
+   return true;
+}
+
+void SuS::logfile::output_stream_stomp::on_socket_ready(
+      unsigned long _connection, unsigned _events) {
+   (void)_events;
+   auto failed = false;
+   {
+      std::lock_guard<std::mutex> lk(m_io_mutex);
+      if (_connection != m_connection) {
+         return;
+      }
+      try {
+         // SSL might need the socket to be readable to continue writing,
+         // so try on every event.
+         if (!m_out.empty() && flush()) {
+            net_reactor::instance()->modify(m_fd, fd_poller::readable);
+         }
+         // read until the socket (and OpenSSL's buffer) is empty. read
+         // directly into the parser's buffer.
+         while (true) {
+            // prepare() may grow the buffer => call it before space().
+            const auto buf = m_parser->prepare();
+            const auto bytes = m_socket->read_some(
+                  reinterpret_cast<uint8_t *>(buf),
+                  unsigned(m_parser->space()));
+            if (bytes < 0) {
+               break;
+            }
+            if (bytes == 0) {
+               SuS_LOG(warning, log_id(), "Connection closed by server.");
+               failed = true;
+               break;
+            }
+            m_last_read = std::chrono::steady_clock::now();
+            const auto ok = m_parser->commit(size_t(bytes));
+#ifdef AMQ_4710_workaround
+            if (m_parser->take_data_seen()) {
+               m_last_was_data = true;
+            }
+#endif
+            if (!ok) {
+               failed = true;
+               break;
+            }
+         }
+      } catch (const std::runtime_error &e) {
+         SuS_LOG_STREAM(warning, log_id(), "Socket error: " << e.what());
+         failed = true;
+      }
+   }
+   if (failed) {
+      disconnect(_connection);
+   }
+} // output_stream_stomp::on_socket_ready
+
+void SuS::logfile::output_stream_stomp::send_heartbeat(
+      unsigned long _connection) {
+   const auto interval = std::chrono::milliseconds(m_heartbeat_send_interval);
+   {
+      std::lock_guard<std::mutex> lk(m_io_mutex);
+      if (_connection != m_connection) {
+         return;
+      }
+      const auto now = std::chrono::steady_clock::now();
+      auto due = m_last_write + interval;
+      if (now >= due) {
+         // when data is still queued, the server is going to receive
+         // something anyway.
+         if (m_out.empty()) {
+            try {
+               static const char eol = '\n';
+               if (send_locked(&eol, 1U)) {
+                  net_reactor::instance()->modify(
+                        m_fd, fd_poller::readable | fd_poller::writable);
+               }
+            } catch (const std::exception &) {
+               SuS_LOG(warning, log_id(), "Sending heart-beat failed.");
+               due = now;
+            }
+         }
+         if (due != now) {
+            due = now + interval;
+         }
+      }
+      if (due != now) {
+         net_reactor::instance()->add_timer(due,
+               [this, _connection]() { send_heartbeat(_connection); }, this);
+         return;
+      }
+   }
+   disconnect(_connection);
+} // output_stream_stomp::send_heartbeat
+
+void SuS::logfile::output_stream_stomp::check_heartbeat(
+      unsigned long _connection) {
+   // grace period as recommended by the STOMP spec.
+   const auto timeout =
+         std::chrono::milliseconds(m_heartbeat_interval * 3 / 2);
+   {
+      std::lock_guard<std::mutex> lk(m_io_mutex);
+      if (_connection != m_connection) {
+         return;
+      }
+      const auto now = std::chrono::steady_clock::now();
+      auto due = m_last_read + timeout;
+#ifdef AMQ_4710_workaround
+      // bug AMQ-4710: after a data packet, the next heartbeat period might
+      // be twice what was requested.
+      // TODO: in principle, the connection string from the server could be
+      // checked against a list of servers requiring this workaround.
+      // "server:ActiveMQ/5.6.0"
+      // https://issues.apache.org/jira/browse/AMQ-4710 : fix foreseen for
+      // 5.12.0.
+      if ((now >= due) && m_last_was_data) {
+         m_last_was_data = false;
+         due = now + timeout;
+      }
+#endif
+      if (now < due) {
+         net_reactor::instance()->add_timer(due,
+               [this, _connection]() { check_heartbeat(_connection); }, this);
+         return;
+      }
+   }
+   SuS_LOG(warning, log_id(), "No heart-beat from server.");
+   disconnect(_connection);
+} // output_stream_stomp::check_heartbeat
+
 std::string SuS::logfile::output_stream_stomp::name() {
-   return std::string{"stomp: "} + m_stomp_URL->host;
+   auto ret = std::string{"stomp: "};
+   for (const auto &i : m_brokers) {
+      if (&i != &m_brokers.front()) {
+         ret += ',';
+      }
+      ret += i->socket_path.empty() ? i->host : i->socket_path;
+   }
+   return ret;
 } // output_stream_stomp::name
 
 unsigned SuS::logfile::output_stream_stomp::retry_time() {
    // the connection is (hopefully) fast.
-   // this leads to a retry period of 2 seconds while we try to connect,
-   // and 30 seconds between connection attempts.
-   return m_connecting ? 2U : 30U;
+   // this leads to a retry period of 2 seconds while we try to connect.
+   {
+      std::lock_guard<std::mutex> lk(m_connect_mutex);
+      if (m_connect_pending) {
+         return 2U;
+      }
+   }
+   // no connect_thread() run failed yet: the connection just broke down
+   // => retry after 2 seconds, as while connecting. otherwise all brokers
+   // have been tried in the last run => back off exponentially, starting
+   // from 5 seconds and up to 60 seconds.
+   const unsigned rounds = m_failed_rounds;
+   if (rounds == 0U) {
+      return 2U;
+   }
+   return std::min(5U << std::min(rounds - 1U, 4U), 60U);
 }
 
-bool SuS::logfile::output_stream_stomp::connect() {
-   if (!m_connected) {
-      if (m_connecting.exchange(true)) {
-         if (m_connect_thread_done) {
-            m_connecting = false;
-            m_connect_thread.join();
-            if (!m_connected) {
-               // connection attempt failed
-               return false;
-            }
-         } else {
-            // still trying to connect
-            return false;
-         }
-      } else {
-         // m_connecting was false
-         SuS_LOG(finest, log_id(), "Starting connect thread.");
-         m_connect_thread_done = false;
-         m_connect_thread =
-               std::thread(&output_stream_stomp::connect_thread, this);
-         return false;
+std::vector<std::string> SuS::logfile::output_stream_stomp::split_URL_list(
+      const std::string &_URLs) {
+   std::vector<std::string> ret;
+   std::string::size_type start = 0U;
+   while (true) {
+      const auto comma = _URLs.find(',', start);
+      const auto url = _URLs.substr(start, comma - start);
+      if (!url.empty()) {
+         ret.push_back(url);
+      }
+      if (comma == std::string::npos) {
+         break;
       }
+      start = comma + 1;
    }
-   return true;
+   return ret;
+} // output_stream_stomp::split_URL_list
+
+bool SuS::logfile::output_stream_stomp::connect() {
+   if (m_connected) {
+      return true;
+   }
+   std::lock_guard<std::mutex> lk(m_connect_mutex);
+   if (m_connect_pending) {
+      // still trying to connect
+      return false;
+   }
+   if (m_connected) {
+      // the attempt finished in the meantime.
+      return true;
+   }
+   // DNS, TCP, SOCKS and SSL handshakes block => leave them to the
+   // reactor's threads for blocking tasks.
+   SuS_LOG(finest, log_id(), "Starting connect.");
+   m_connect_pending = true;
+   net_reactor::instance()->post_blocking(
+         [this]() { connect_thread(); }, this);
+   return false;
+}
+
+void SuS::logfile::output_stream_stomp::dump(std::ostream &_stream) {
+   output_stream::dump(_stream);
+   _stream << "     receipts from level: "
+           << logger::level_name(m_receipt_min_level) << std::endl;
+   _stream << "     content-length: " << (m_content_length ? "yes" : "no")
+           << std::endl;
+}
+
+void SuS::logfile::output_stream_stomp::set_receipt_min_level(
+      logger::log_level _level) {
+   m_receipt_min_level = _level;
+}
+
+void SuS::logfile::output_stream_stomp::set_content_length(bool _enable) {
+   m_content_length = _enable;
 }
 
 bool SuS::logfile::output_stream_stomp::do_write(const log_event &_le) {
+   const auto acknowledged = (_le.level >= m_receipt_min_level);
    if (!connect()) {
-      return false;
+      // fire-and-forget messages are not worth a retry.
+      return !acknowledged;
    }
 
-   std::ostringstream body;
-   body << "<map>\n"
-           "<entry><string>APPLICATION-ID</string><string>"
-        << m_app_name << "</string></entry>\n"
-                         "<entry><string>CREATETIME</string><string>"
-        << _le.time_string << "</string></entry>\n"
-                              "<entry><string>HOST</string><string>"
-        << m_host << "</string></entry>\n"
-                     "<entry><string>NAME</string><string>"
-        << sanitize_string(_le.function)
-        << "</string></entry>\n"
-           "<entry><string>SEVERITY</string><string>"
-        << m_level_strings.at(_le.level)
-        << "</string></entry>\n"
-           "<entry><string>TEXT</string><string>"
-        << sanitize_string(_le.message)
-        << "</string></entry>\n"
-           "<entry><string>TYPE</string><string>log</string></entry>\n"
-           "<entry><string>USER</string><string>"
-        << m_user << "</string></entry>\n"
-                     "<entry><string>CLASS</string><string>"
-        << sanitize_string(_le.subsystem_string) << "</string></entry>\n"
-                                                    "</map>\n";
-
-   std::ostringstream header;
-   // receipt:42
-   // => RECEIPT\nreceipt-id:42\n\n\0
-   ++m_receipt;
-   header
-         << "SEND\n"
-            "destination:/topic/"
-         << m_stomp_URL->path
-         << "\n"
-            "transformation:jms-map-xml\n"
-            // setting content-length as per the STOMP specification gives:
-            // org.csstudio.sns.jms2rdb.LogClientThread (onMessage) - Received
-            // unhandled message type
-            // org.apache.activemq.command.ActiveMQBytesMessage
-            // this is probably due to "https://activemq.apache.org/stomp.html":
-            // Inclusion of content-length header     Resulting Message
-            // yes                                    BytesMessage
-            // no                                     TextMessage
-            // "content-length:" << body.tellp() << "\n"
-            "receipt:"
-         << m_receipt << "\n"
-                         "\n";
-   const auto packet =
-         header.str() + body.str() + '\0'; // this is a real 0-byte to be sent
+   // assemble the frame in the reusable buffer. clear() keeps the capacity,
+   // so after the first few messages no allocations happen here.
+   m_frame.clear();
+   m_frame.append(m_send_prefix);
+   if (acknowledged) {
+      // receipt:42
+      // => RECEIPT\nreceipt-id:42\n\n\0
+      ++m_receipt;
+      char receipt[16];
+      const auto receipt_len = format_receipt(m_receipt, receipt);
+      m_frame.append("receipt:", 8);
+      m_frame.append(receipt, receipt_len);
+      m_frame.push_back('\n');
+   }
+   if (_le.sample_rate > 1U) {
+      // a JMS property, so that consumers can scale counts back up.
+      char rate[16];
+      const auto rate_len = format_receipt(_le.sample_rate, rate);
+      m_frame.append("sample-rate:", 12);
+      m_frame.append(rate, rate_len);
+      m_frame.push_back('\n');
+   }
+   const auto headers_len = m_frame.size();
+   m_frame.push_back('\n');
+
+   m_frame.append(m_body_createtime);
+   m_frame.append(_le.time_string);
+   m_frame.append(m_body_name);
+   append_sanitized(m_frame, _le.function);
+   m_frame.append(m_body_severity);
+   m_frame.append(m_level_strings.at(_le.level));
+   m_frame.append(m_body_text);
+   append_sanitized(m_frame, _le.message);
+   m_frame.append(m_body_class);
+   append_sanitized(m_frame, _le.subsystem_string);
+   m_frame.append(m_body_end);
+   if (m_content_length) {
+      // the body is complete only now => insert the header in front of the
+      // empty line.
+      char len[16];
+      const auto len_len = format_receipt(
+            unsigned(m_frame.size() - headers_len - 1U), len);
+      m_frame.insert(headers_len, "content-length:");
+      m_frame.insert(headers_len + 15U, len, len_len);
+      m_frame.insert(headers_len + 15U + len_len, 1U, '\n');
+   }
+   m_frame.push_back('\0'); // this is a real 0-byte to be sent
+   if (acknowledged) {
+      // the reply may arrive before send() returns.
+      std::lock_guard<std::mutex> lk(m_reply_mutex);
+      m_reply_expected = true;
+      m_reply_receipt = m_receipt;
+   }
    try {
-      m_socket->write((const uint8_t *)(packet.c_str()), packet.length());
+      send(m_frame.data(), m_frame.size());
    } catch (const std::exception &) {
       disconnect();
-      return false;
+      return !acknowledged;
+   }
+   if (!acknowledged) {
+      // no receipt requested => nothing to wait for.
+      return true;
    }
 
    std::unique_lock<std::mutex> lk(m_reply_mutex);
-   if (!m_reply_queue.size()) {
-      // there is a tiny chance that the reply might have been received in the
-      // meantime.
-      const auto stat = m_reply_cv.wait_for(lk, std::chrono::seconds(6));
-      if (stat == std::cv_status::timeout) {
-         SuS_LOG(warning, log_id(), "Timeout.");
-         disconnect();
-         return false;
-      }
+   // a broken connection ends the wait early.
+   if (!m_reply_cv.wait_for(lk, std::chrono::seconds(6), [this]() {
+          return !m_reply_queue->empty() || !m_connected;
+       })) {
+      m_reply_expected = false;
+      lk.unlock();
+      SuS_LOG(warning, log_id(), "Timeout.");
+      disconnect();
+      return false;
+   }
+   if (m_reply_queue->empty()) {
+      // disconnected by the net_reactor.
+      m_reply_expected = false;
+      return false;
    }
 
-   const auto reply = m_reply_queue.front();
-   m_reply_queue.pop_front();
+   const auto reply = m_reply_queue->front();
+   m_reply_queue->pop_front();
    lk.unlock();
    if (reply.command != "RECEIPT") {
       // if it's an ERROR, it has already been logged.
       disconnect();
       return false;
    }
-   const auto id = reply.headers.find("receipt-id");
-   if (id == reply.headers.end()) {
+   if (!reply.has_receipt_id) {
       SuS_LOG(warning, log_id(), "no receipt-id");
       disconnect();
       return false;
    }
-   std::ostringstream expected;
-   expected << m_receipt;
-   return expected.str() == id->second;
+   return reply.receipt_id == m_receipt;
 } // output_stream_stomp::do_write
 
-void SuS::logfile::output_stream_stomp::reader_thread() {
-   char buf[1537];
-   while (true) {
-      // heartbeat interval 0 => no timeout in call to select().
-      // buf-1 : make sure that we can append a '\0'.
-      ssize_t bytesLeft = read_with_timeout(
-            reinterpret_cast<uint8_t *>(buf), sizeof buf-1, m_heartbeat_interval *
-                  1000 /* ms to us */ * 1.5 /* grace period. */);
-      // when using SSL it could happen that select is woken up by a SSL
-      // control message and no user data is available.
-      // TODO: how to detect this case. how likely is it anyway?
-      if (bytesLeft <= 0) {
-         SuS_LOG(warning, log_id(), "read_with_timeout failed");
-         disconnect();
-         // end thread
-         break;
-      }
-      // 1 past the received data.
-      const auto end = buf + bytesLeft;
-      // make sure the strchr below terminates within buf.
-      *end = '\0';
-      // start-of-(non-heartbeat)-data
-      const char *sod = buf;
-      // past last received byte
-      while (bytesLeft) {
-         // !m_partial_reply.empty() => in the middle of a reply.
-         while (m_partial_reply.empty() && bytesLeft && (*sod == '\n')) {
-            // first bytes is '\n' => heartbeat received
-            // there might still be data to follow, if the heartbeat came right
-            // before other data.
-            // while: theoretically, we could have several heartbeat bytes.
-            ++sod;
-            --bytesLeft;
-         }
-         if (!bytesLeft) {
-            // heartbeat, but no data => just move on.
-            continue;
-         }
-         // ptr points to the first non-heartbeat data byte.
-         m_last_was_data = true;
-
-         const char *i = ::strchr(sod, '\0');
-         // i either points to the end of the string, or to the \0 byte.
-         // in each case, this is just what we want to append, i.e. past the
-         // last interesting byte.
-         m_partial_reply.append(sod, i);
-         if (i != end) {
-            // '\0' found => reply complete
-            const bool ret = handle_reply(m_partial_reply);
-            m_partial_reply.clear();
-            if (!ret) {
-               disconnect();
-               // end thread
-               break;
-            }
-            // skip the '\0'
-            ++i;
-         }
-         sod = i;
-         bytesLeft = end - sod;
-      }
-   }
-} // output_stream_stomp::reader_thread
-
 bool SuS::logfile::output_stream_stomp::handle_reply(
-      const std::string &_frame) {
-   // first line is the command that triggered the reply.
-   auto i = _frame.find('\n');
-   if (i == std::string::npos)
-      return false;
-   stomp_reply reply;
-   reply.command.assign(_frame, 0, i);
-
-   const auto size = _frame.size();
-   // parse the headers
-   while (true) {
-      if (size < i + 1) {
-         // overran string
-         return false;
-      }
-      // start with the next character after the '\n' i points to.
-      const auto oldi = i + 1;
-      i = _frame.find('\n', oldi);
-      if (i == std::string::npos) {
-         // a STOMP frame always ends with '\n' (the '\0' has already been
-         // dropped).
-         return false;
-      }
-      if (i == oldi) { // two \n in a row => end of headers
-         break;
-      }
-      const auto line = std::string{_frame, oldi, i - oldi};
-      const auto colon = line.find(':');
-      if (colon == std::string::npos) {
-         // no ':' in a header line
-         return false;
-      }
-      const auto key = std::string{line, 0, colon};
-      // TODO: undo encoding according to STOMP specification
-      const auto value = std::string{line, colon + 1, std::string::npos};
-      if (reply.headers.find(key) != reply.headers.end()) {
-         // repeated keys are ignored
-         continue;
-      }
-      // TODO: handle content-length
-      reply.headers.emplace(key, value);
-   }
-
-   // remaining string: body
-   if (size < i + 1) {
-      // overran string
-      return false;
-   }
-   reply.body.assign(_frame, i + 1, std::string::npos);
-
-   if (reply.command == "ERROR") {
+      const stomp_frame &_frame) {
+   if (_frame.command == "ERROR") {
       std::string err_text{"ERROR from server"};
-      const auto &msg = reply.headers.find("message");
-      if (msg != reply.headers.end()) {
+      const auto &msg = _frame.headers.find("message");
+      if (msg != _frame.headers.end()) {
          err_text.append(": ");
          err_text.append(msg->second);
       }
       SuS_LOG(warning, log_id(), err_text);
       line_splitter ls{
             [](const std::string &_s) { SuS_LOG(fine, log_id(), _s); }};
-      ls.read_and_forward(reply.body.data(), reply.body.size());
+      ls.read_and_forward(_frame.body.data(), _frame.body.size());
    }
 
    {
       std::lock_guard<std::mutex> lk(m_reply_mutex);
-      m_reply_queue.push_back(reply);
+      if (!m_reply_expected || !answers_receipt(_frame)) {
+         // e.g. an ERROR caused by a fire-and-forget SEND, logged above.
+         // nobody would pop it, and the next acknowledged write would take
+         // it for its reply => drop it. the server closes the connection
+         // after an ERROR, which ends the wait for the reply anyway.
+         return true;
+      }
+      m_reply_expected = false;
+      m_reply_queue->push_back(_frame);
    }
    m_reply_cv.notify_one();
    return true;
 } // output_stream_stomp::handle_reply
 
+bool SuS::logfile::output_stream_stomp::answers_receipt(
+      const stomp_frame &_frame) const {
+   if ((m_reply_receipt == 0U) || (_frame.command != "ERROR")) {
+      // an ERROR answers CONNECT. a RECEIPT is checked by do_write().
+      return true;
+   }
+   // a SEND with a receipt header SHOULD be answered with an ERROR
+   // carrying the same receipt-id.
+   const auto &id = _frame.headers.find("receipt-id");
+   if (id == _frame.headers.end()) {
+      return false;
+   }
+   char receipt[16];
+   const auto receipt_len = format_receipt(m_reply_receipt, receipt);
+   return id->second == std::string(receipt, receipt_len);
+} // output_stream_stomp::answers_receipt
+
 bool SuS::logfile::output_stream_stomp::check_server_version(
-      const stomp_reply &_reply) {
+      const stomp_frame &_reply) {
    // from the STOMP spec:
    // STOMP 1.1 servers MUST set the following headers:
    // version : The version of the STOMP protocol the session will be using.
@@ -448,16 +791,19 @@ bool SuS::logfile::output_stream_stomp::check_server_version(
       SuS_LOG(warning, log_id(), "No version header in CONNECTED frame.");
       return false;
    }
-   if (ver->second != "1.1") {
+   // 1.2 only adds things we handle anyway (\r\n line endings, \r
+   // escaping in encode_header()) or do not use (ACK/NACK ids).
+   if ((ver->second != "1.1") && (ver->second != "1.2")) {
       SuS_LOG_STREAM(warning, log_id(), "STOMP server requests version "
                   << ver->second << ", that we don't speak.");
       return false;
    }
+   SuS_LOG_STREAM(config, log_id(), "Using STOMP " << ver->second << ".");
    return true;
 } // output_stream_stomp::check_server_version
 
 bool SuS::logfile::output_stream_stomp::parse_heartbeat(
-      const stomp_reply &_reply) {
+      const stomp_frame &_reply) {
    // from the STOMP spec:
    // CONNECTED
    // heart-beat:<sx>,<sy>
@@ -466,6 +812,7 @@ bool SuS::logfile::output_stream_stomp::parse_heartbeat(
    if (hb == _reply.headers.end()) {
       SuS_LOG(info, log_id(), "No heart-beat header in CONNECTED frame.");
       m_heartbeat_interval = 0;
+      m_heartbeat_send_interval = 0;
       return true;
    }
 
@@ -476,79 +823,132 @@ bool SuS::logfile::output_stream_stomp::parse_heartbeat(
       return false;
    }
 
-   const auto sy = hb->second.substr(comma + 1);
-   if (sy != "0") {
-      // we cannot send heart-beats (yet).
-      SuS_LOG_STREAM(warning, log_id(), "Cannot accept heart-beat header '"
-                  << hb->second << "': sy != 0.");
-      return false;
-   }
-
    const auto sx = hb->second.substr(0, comma);
    char *endptr;
-   m_heartbeat_interval = ::strtol(sx.c_str(), &endptr, 10);
-   if (*endptr != '\0') {
+   const auto server_send = ::strtol(sx.c_str(), &endptr, 10);
+   if ((*endptr != '\0') || sx.empty() || (server_send < 0)) {
       SuS_LOG_STREAM(warning, log_id(), "Cannot parse heart-beat header '"
                   << hb->second << "': sx no integer.");
       return false;
    }
+   const auto sy = hb->second.substr(comma + 1);
+   const auto server_receive = ::strtol(sy.c_str(), &endptr, 10);
+   if ((*endptr != '\0') || sy.empty() || (server_receive < 0)) {
+      SuS_LOG_STREAM(warning, log_id(), "Cannot parse heart-beat header '"
+                  << hb->second << "': sy no integer.");
+      return false;
+   }
+
+   // negotiation as per the STOMP spec: 0 on either side disables the
+   // direction, otherwise the larger of the two values is used.
+   m_heartbeat_interval = (server_send == 0)
+         ? 0
+         : std::max(server_send, s_heartbeat_receive_ms);
+   m_heartbeat_send_interval = (server_receive == 0)
+         ? 0
+         : std::max(server_receive, s_heartbeat_send_ms);
+
    if (m_heartbeat_interval) {
-      SuS_LOG_STREAM(finer, log_id(),
-            "Heartbeat interval = " << m_heartbeat_interval << "ms.");
+      SuS_LOG_STREAM(finer, log_id(), "Incoming heartbeat interval = "
+                  << m_heartbeat_interval << "ms.");
    } else {
-      SuS_LOG_STREAM(config, log_id(), "No heartbeat.");
+      SuS_LOG_STREAM(config, log_id(), "No incoming heartbeat.");
+   }
+   if (m_heartbeat_send_interval) {
+      SuS_LOG_STREAM(finer, log_id(), "Outgoing heartbeat interval = "
+                  << m_heartbeat_send_interval << "ms.");
+   } else {
+      SuS_LOG_STREAM(config, log_id(), "No outgoing heartbeat.");
    }
    return true;
 }
 
-ssize_t SuS::logfile::output_stream_stomp::read_with_timeout(
-      uint8_t *const _data, size_t _len, unsigned long _timeout_us) {
-   try {
-      if (!m_socket->select_read(_timeout_us)) {
-#ifdef AMQ_4710_workaround
-         // bug AMQ-4710: after a data packet, the next heartbeat period might
-         // be twice what was requested.
-         // TODO: in principle, the connection string from the server could be
-         // checked against a list of servers requiring this workaround.
-         // "server:ActiveMQ/5.6.0"
-         // https://issues.apache.org/jira/browse/AMQ-4710 : fix foreseen for
-         // 5.12.0.
-         if (m_last_was_data) {
-            m_last_was_data = false;
-            return read_with_timeout(_data, _len, _timeout_us);
-         }
-#endif
-         return -1;
-      } else {
-         return m_socket->read(_data, _len);
+unsigned SuS::logfile::output_stream_stomp::format_receipt(
+      unsigned _receipt, char *_buf) {
+   // digits are produced in reverse order.
+   char tmp[16];
+   unsigned len = 0U;
+   do {
+      tmp[len++] = char('0' + _receipt % 10U);
+      _receipt /= 10U;
+   } while (_receipt);
+   for (unsigned i = 0U; i < len; ++i) {
+      _buf[i] = tmp[len - 1U - i];
+   }
+   return len;
+} // output_stream_stomp::format_receipt
+
+void SuS::logfile::output_stream_stomp::append_sanitized(
+      std::string &_out, const std::string &_in) {
+   // copy runs of harmless characters in one go and only handle the
+   // characters that need escaping individually.
+   auto run_start = _in.data();
+   const auto end = _in.data() + _in.size();
+   for (auto p = run_start; p != end; ++p) {
+      const char *replacement;
+      switch (*p) {
+      case '&':
+         replacement = "&amp;";
+         break;
+      case '"':
+         replacement = "&quot;";
+         break;
+      case '\'':
+         replacement = "&apos;";
+         break;
+      case '<':
+         replacement = "&lt;";
+         break;
+      case '>':
+         replacement = "&gt;";
+         break;
+      case '\0':
+         replacement = "\\0";
+         break;
+      default:
+         continue;
       }
-   } catch (const std::runtime_error &) {
-      m_socket->disconnect();
-      return -1;
+      _out.append(run_start, p);
+      _out.append(replacement);
+      run_start = p + 1;
    }
-} // output_stream_stomp::read_with_timeout
-
-std::string SuS::logfile::output_stream_stomp::replace_all(
-      std::string str, const std::string &_pattern, const std::string &_new) {
-   auto pos = std::string::size_type{0};
-   while ((pos = str.find(_pattern, pos)) != std::string::npos) {
-      str.replace(pos, _pattern.length(), _new);
-      pos += _new.length();
+   _out.append(run_start, end);
+} // output_stream_stomp::append_sanitized
+
+std::string SuS::logfile::output_stream_stomp::encode_header(
+      const std::string &_in, bool _escape_cr) {
+   std::string ret;
+   ret.reserve(_in.size());
+   for (const auto c : _in) {
+      switch (c) {
+      case '\r':
+         // STOMP 1.1 has no escape for it, and no \r\n line endings either.
+         if (_escape_cr) {
+            ret += "\\r";
+         } else {
+            ret += c;
+         }
+         break;
+      case '\n':
+         ret += "\\n";
+         break;
+      case ':':
+         ret += "\\c";
+         break;
+      case '\\':
+         ret += "\\\\";
+         break;
+      default:
+         ret += c;
+      }
    }
-   return str;
-}
+   return ret;
+} // output_stream_stomp::encode_header
 
 std::string SuS::logfile::output_stream_stomp::sanitize_string(
       const std::string &_in) {
-   // "&" must go first! std::map re-orders, so place this here.
-   auto cur = replace_all(_in, "&", "&amp;");
-
-   static const std::map<const char *, const char *> replacements = {
-         {"\"", "&quot;"}, {"'", "&apos;"}, {"<", "&lt;"}, {">", "&gt;"}};
-   for (const auto &i : replacements) {
-      cur = replace_all(cur, i.first, i.second);
-   }
-   // we use const char* in the map, so \0 would be empty => special case.
-   cur = replace_all(cur, std::string("\0", 1), "\\0");
-   return cur;
+   std::string ret;
+   ret.reserve(_in.size());
+   append_sanitized(ret, _in);
+   return ret;
 } // output_stream_stomp::sanitize_string
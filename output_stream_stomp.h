@@ -9,13 +9,14 @@
 #include "output_stream.h"
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <deque>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <string>
-#include <thread>
+#include <vector>
 
 #ifdef _WINDOWS
 #undef ssize_t
@@ -28,71 +29,194 @@ struct URL_info;
 
 namespace logfile {
 
+class stomp_frame_parser;
 class tcp_client_socket;
-
+struct stomp_frame;
+
+//! Sink sending log messages to a STOMP broker as JMS map messages.
+/*!
+ * Several brokers can be given for failover. They are tried in the given
+ * order on every (re)connect, and the first one accepting the connection is
+ * used. When all brokers fail, the time until the next attempt is doubled
+ * up to a limit.
+ */
 class LOGFILE_EXPORT output_stream_stomp : public output_stream {
  public:
+   //! Initialize the sink.
+   /*!
+    * @param _app_name Application name sent with every message.
+    * @param _URL URL of the broker, e.g. stomp+ssl://user:pw@host:port/topic,
+    * or stomp+unix:///path/to/socket#topic for a local broker.
+    * Several URLs can be given separated by ','.
+    */
    output_stream_stomp(const std::string &_app_name, const std::string &_URL);
+   //! Initialize the sink with a list of brokers in failover order.
+   output_stream_stomp(
+         const std::string &_app_name, const std::vector<std::string> &_URLs);
 
    virtual ~output_stream_stomp();
 
    virtual bool do_write(const log_event &_le) override;
 
+   virtual void dump(std::ostream &_stream) override;
+
+   //! Request receipts only for messages of at least _level.
+   /*!
+    * Less important messages are sent without a receipt header. They do
+    * not wait for the broker, and they are dropped instead of retried when
+    * they cannot be sent. Default: logger::log_level::finest, i.e. every
+    * message is acknowledged.
+    */
+   void set_receipt_min_level(logger::log_level _level);
+
+   //! Send a content-length header with every message.
+   /*!
+    * This is what the STOMP specification recommends, but ActiveMQ turns
+    * messages with content-length into a BytesMessage instead of a
+    * TextMessage (see https://activemq.apache.org/stomp.html), which
+    * e.g. the CSS JMS2RDB service does not handle. Therefore only enable
+    * this when the consumers of the topic accept it. Default: off.
+    */
+   void set_content_length(bool _enable);
+
    virtual std::string name() override;
    virtual unsigned retry_time() override;
 
-   void reader_thread();
-
  private:
    // NOP when already connected. Just returns true in this case.
    bool connect();
-   // intended to be run in a thread
+   //! Try all brokers. Run on a net_reactor thread for blocking tasks.
    void connect_thread();
+   //! Connect to one of the brokers and make it the current one.
+   bool connect_to_broker(size_t _index);
 
-   void disconnect();
-
-   ssize_t read_with_timeout(
-         uint8_t *const _data, size_t _len, unsigned long _timeout_us);
+   static std::vector<std::string> split_URL_list(const std::string &_URLs);
 
-   static std::string replace_all(
-         std::string str, const std::string &_pattern, const std::string &_new);
+   //! Close the current connection.
+   void disconnect();
+   //! Close the connection, if _connection is still the current one.
+   void disconnect(unsigned long _connection);
+
+   //! Write to the socket, or queue what cannot be written right now.
+   void send(const char *_data, size_t _len);
+   //! \ref send with m_io_mutex held.
+   /*!
+    * @return True, if data is left in m_out.
+    */
+   bool send_locked(const char *_data, size_t _len);
+   //! Write as much of m_out as possible. Needs m_io_mutex.
+   /*!
+    * @return True, if m_out is empty afterwards.
+    */
+   bool flush();
+
+   //! Called by the net_reactor when the socket is ready.
+   void on_socket_ready(unsigned long _connection, unsigned _events);
+   //! Timer: send a heart-beat when nothing has been written for an
+   //! interval.
+   void send_heartbeat(unsigned long _connection);
+   //! Timer: drop the connection when the server stopped sending.
+   void check_heartbeat(unsigned long _connection);
+
+   //! Write the decimal representation of _receipt to _buf.
+   /*!
+    * @param _buf Buffer of at least 10 characters. No '\0' is appended.
+    * @return Number of characters written.
+    */
+   static unsigned format_receipt(unsigned _receipt, char *_buf);
+   //! Append _in to _out with XML special characters escaped.
+   static void append_sanitized(std::string &_out, const std::string &_in);
    static std::string sanitize_string(const std::string &_in);
+   //! Escape a header value for frames other than CONNECT.
+   /*!
+    * @param _escape_cr Escape '\r' as well, which only STOMP 1.2 defines.
+    */
+   static std::string encode_header(const std::string &_in, bool _escape_cr);
 
    const std::string m_app_name;
    //! Name of the host running the logger.
    std::string m_host;
-   std::unique_ptr<URL_info> m_stomp_URL;
+   //! All configured brokers in failover order.
+   std::vector<std::unique_ptr<URL_info>> m_brokers;
+   //! The broker currently in use (one of m_brokers).
+   URL_info *m_stomp_URL;
    std::string m_user;
-   std::thread *m_heartbeat_thread;
+   //! Negotiated interval of heart-beats from the server in ms.
    long m_heartbeat_interval{0};
+   //! Negotiated interval of heart-beats to the server in ms.
+   long m_heartbeat_send_interval{0};
+   //! Serializes the use of the socket by the log thread and the
+   //! net_reactor. Protects m_socket, m_parser and the members up to m_fd.
+   std::mutex m_io_mutex;
+   //! Data the socket did not accept yet.
+   std::string m_out;
+   std::chrono::steady_clock::time_point m_last_write;
+   std::chrono::steady_clock::time_point m_last_read;
+   //! Incremented on every disconnect, so that callbacks still scheduled
+   //! for an old connection do nothing.
+   unsigned long m_connection{0U};
+   //! The socket is registered with the net_reactor as m_fd.
+   bool m_registered{false};
+   int m_fd{-1};
    std::map<logger::log_level, const char *const> m_level_strings;
    unsigned m_receipt{0U};
+   std::atomic<logger::log_level> m_receipt_min_level{
+         logger::log_level::finest};
+   std::atomic<bool> m_content_length{false};
+
+   // constant fragments of the SEND frame, rendered once in the constructor.
+   // the variable parts of a log_event go between them.
+   std::string m_send_prefix;
+   std::string m_body_createtime;
+   std::string m_body_name;
+   std::string m_body_severity;
+   std::string m_body_text;
+   std::string m_body_class;
+   std::string m_body_end;
+   //! Reusable buffer the SEND frames are assembled in.
+   std::string m_frame;
 #ifdef AMQ_4710_workaround
    bool m_last_was_data = false;
 #endif
 
-   std::string m_partial_reply;
-
-   struct stomp_reply {
-      std::string command;
-      std::map<std::string, std::string> headers;
-      std::string body;
-   };
-   std::deque<stomp_reply> m_reply_queue;
+   //! Splits the data received by \ref on_socket_ready into frames.
+   std::unique_ptr<stomp_frame_parser> m_parser;
+
+   //! Behind a pointer, so that stomp_frame need not be complete here.
+   std::unique_ptr<std::deque<stomp_frame>> m_reply_queue;
+   //! A frame was sent that the server answers (CONNECT, or SEND with a
+   //! receipt header) and the answer has not arrived yet. Other frames
+   //! are not queued.
+   bool m_reply_expected{false};
+   //! The receipt header of that SEND, 0 for CONNECT.
+   unsigned m_reply_receipt{0U};
    std::mutex m_reply_mutex;
    std::condition_variable m_reply_cv;
 
-   std::unique_ptr<tcp_client_socket> m_socket;
-
-   bool m_connected{false};
-   std::atomic<bool> m_connecting{false};
-   std::thread m_connect_thread;
-   std::atomic<bool> m_connect_thread_done{false};
-
-   bool handle_reply(const std::string &_frame);
-
-   bool check_server_version(const stomp_reply &_reply);
-   bool parse_heartbeat(const stomp_reply &_reply);
+   //! One socket per broker, same order as m_brokers.
+   std::vector<std::unique_ptr<tcp_client_socket>> m_sockets;
+   //! The socket currently in use (one of m_sockets).
+   tcp_client_socket *m_socket;
+   //! Number of connect_thread() runs in a row that found no broker.
+   std::atomic<unsigned> m_failed_rounds{0U};
+
+   std::atomic<bool> m_connected{false};
+   //! A connect_thread() run has been posted and not finished yet.
+   bool m_connect_pending{false};
+   std::mutex m_connect_mutex;
+   std::condition_variable m_connect_cv;
+   //! Tells a pending connect_thread() to give up.
+   std::atomic<bool> m_closing{false};
+
+   bool handle_reply(const stomp_frame &_frame);
+   //! Whether _frame is the answer to the frame in m_reply_receipt.
+   /*!
+    * Must be called with m_reply_mutex held.
+    */
+   bool answers_receipt(const stomp_frame &_frame) const;
+
+   bool check_server_version(const stomp_frame &_reply);
+   bool parse_heartbeat(const stomp_frame &_reply);
 }; // class output_stream_stomp
 } // namespace logfile
 } // namespace SuS
@@ -74,6 +74,26 @@ void SuS::parse_URL(const std::string &_url, URL_info &_parts) {
       host_port = at + 1;
    }
 
+   const auto unix_suffix = std::string{"+unix"};
+   if ((ret.protocol.size() > unix_suffix.size()) &&
+         (ret.protocol.compare(ret.protocol.size() - unix_suffix.size(),
+                unix_suffix.size(), unix_suffix) == 0)) {
+      // no host and port, but an absolute path to the socket. the path is
+      // taken literally, so that '+' is not turned into a space.
+      auto socket_path = _url.substr(host_port);
+      const auto hash = socket_path.find('#');
+      if (hash != std::string::npos) {
+         ret.path = decode_hex_byte(socket_path.substr(hash + 1));
+         socket_path.erase(hash);
+      }
+      if (socket_path.empty() || (socket_path[0] != '/')) {
+         throw std::invalid_argument{"Invalid URL: No socket path."};
+      }
+      ret.socket_path = socket_path;
+      _parts = ret;
+      return;
+   }
+
    auto slash = _url.find('/', host_port);
    if (slash != std::string::npos) {
       ret.path = decode_hex_byte(_url.substr(slash + 1));
@@ -114,6 +134,7 @@ std::ostream &operator<<(std::ostream &_s, const SuS::URL_info &_url) {
       << "password: '" << _url.password << "'" << std::endl
       << "host:     '" << _url.host << "'" << std::endl
       << "port :    '" << _url.port << "'" << std::endl
-      << "path :    '" << _url.path << "'" << std::endl;
+      << "path :    '" << _url.path << "'" << std::endl
+      << "socket:   '" << _url.socket_path << "'" << std::endl;
    return _s;
 }
@@ -17,6 +17,8 @@ struct LOGFILE_EXPORT URL_info {
    std::string host;
    uint16_t port;
    std::string path;
+   //! Path of a Unix domain socket (protocols ending in "+unix").
+   std::string socket_path;
 };
 
 //! Decode a URL containing protocol, login and port information.
@@ -30,6 +32,11 @@ struct LOGFILE_EXPORT URL_info {
  *
  *  Not supported are IPv6 addresses in the form [::1].
  *
+ *  For protocols ending in "+unix", the URL names a Unix domain socket
+ *  instead of host and port:
+ *  protocol+unix://login:password@/path/to/socket#path.
+ *  The socket path is stored in socket_path, the part after '#' in path.
+ *
  *  @param _url The URL to parse.
  *  @param _parts The URL_info structure to update.
  */
@@ -0,0 +1,75 @@
+/* SPDX-License-Identifier: MIT */
+#ifdef _MSC_BUILD
+#define NOMINMAX
+#endif
+
+#include "rate_limiter.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+int64_t now_ns() {
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(
+         std::chrono::steady_clock::now().time_since_epoch())
+         .count();
+}
+} // namespace
+
+const int64_t SuS::logfile::rate_limiter::s_summary_period_ns = 1000000000;
+
+void SuS::logfile::rate_limiter::set(double _per_second, unsigned _burst) {
+   const auto interval =
+         (_per_second > 0.) ? std::max<int64_t>(1, int64_t(1e9 / _per_second))
+                            : 0;
+   // set the tolerance first: a concurrent admit() must not see a new
+   // interval with a tolerance of 0.
+   m_tolerance = interval * std::max(_burst, 1U);
+   m_interval = interval;
+} // rate_limiter::set
+
+bool SuS::logfile::rate_limiter::admit() {
+   const auto interval = m_interval.load(std::memory_order_relaxed);
+   if (!interval) {
+      return true;
+   }
+   const auto tolerance = m_tolerance.load(std::memory_order_relaxed);
+   const auto now = now_ns();
+   auto tat = m_tat.load(std::memory_order_relaxed);
+   int64_t next;
+   do {
+      // an empty bucket refills from now on.
+      next = std::max(tat, now) + interval;
+      if (next - now > tolerance) {
+         m_suppressed.fetch_add(1U, std::memory_order_relaxed);
+         return false;
+      }
+   } while (!m_tat.compare_exchange_weak(
+         tat, next, std::memory_order_relaxed));
+   return true;
+} // rate_limiter::admit
+
+unsigned long SuS::logfile::rate_limiter::take_suppressed() {
+   if (!m_suppressed.load(std::memory_order_relaxed)) {
+      return 0U;
+   }
+   const auto now = now_ns();
+   auto due = m_next_summary.load(std::memory_order_relaxed);
+   // only one thread wins the summary.
+   if ((now < due) || !m_next_summary.compare_exchange_strong(due,
+                            now + s_summary_period_ns,
+                            std::memory_order_relaxed)) {
+      return 0U;
+   }
+   return m_suppressed.exchange(0U, std::memory_order_relaxed);
+} // rate_limiter::take_suppressed
+
+double SuS::logfile::rate_limiter::rate() const {
+   const auto interval = m_interval.load();
+   return interval ? 1e9 / double(interval) : 0.;
+} // rate_limiter::rate
+
+unsigned SuS::logfile::rate_limiter::burst() const {
+   const auto interval = m_interval.load();
+   return interval ? unsigned(m_tolerance.load() / interval) : 0U;
+} // rate_limiter::burst
@@ -0,0 +1,60 @@
+/* SPDX-License-Identifier: MIT */
+/*! @file */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace SuS {
+namespace logfile {
+
+//! Lock-free token bucket limiting the messages of one subsystem.
+/*!
+ * The bucket is kept as the time at which it would be full again (the
+ * "theoretical arrival time" of the generic cell rate algorithm). Taking a
+ * token moves that time by one interval. So the whole state is a single
+ * integer, updated with compare-and-swap, and threads logging to the same
+ * subsystem never block each other.
+ *
+ * Rejected messages are counted, so that a summary can be logged instead of
+ * them (see \ref take_suppressed).
+ */
+class rate_limiter {
+ public:
+   //! Set the limit.
+   /*!
+    * @param _per_second Steady rate. 0 turns the limit off.
+    * @param _burst Messages let through at once after a quiet period.
+    */
+   void set(double _per_second, unsigned _burst);
+
+   //! Check, if a message may be logged now, and take a token for it.
+   bool admit();
+
+   //! Number of messages rejected since the last summary.
+   /*!
+    * @return 0, unless messages have been rejected and the last summary is
+    *    at least \ref s_summary_period_ns old. Then the counter is reset.
+    */
+   unsigned long take_suppressed();
+
+   double rate() const;
+   unsigned burst() const;
+
+   //! Minimum time between two summaries.
+   static const int64_t s_summary_period_ns;
+
+ private:
+   //! Nanoseconds per token. 0 means no limit.
+   std::atomic<int64_t> m_interval{0};
+   //! How far the arrival time may run ahead of now: burst * interval.
+   std::atomic<int64_t> m_tolerance{0};
+   //! When the bucket is full again, in steady clock nanoseconds.
+   std::atomic<int64_t> m_tat{0};
+
+   std::atomic<unsigned long> m_suppressed{0U};
+   std::atomic<int64_t> m_next_summary{0};
+}; // class rate_limiter
+
+} // namespace logfile
+} // namespace SuS
@@ -0,0 +1,583 @@
+/* SPDX-License-Identifier: MIT */
+#ifdef _MSC_BUILD
+#define NOMINMAX
+#endif
+
+#include "retry_scheduler.h"
+
+#include "config.h"
+#include "crash_log.h"
+#include "output_stream.h"
+#include "output_stream_private.h"
+
+#include <algorithm>
+#include <ctime>
+#include <iostream>
+#include <iterator>
+#include <string.h>
+#ifdef HAVE_PRCTL
+#include <sys/prctl.h>
+#endif
+
+namespace {
+// 51.2 seconds per turn. longer delays take several turns.
+const size_t s_wheel_slots = 512U;
+
+//! What an event roughly costs in memory.
+size_t event_size(const SuS::logfile::log_event &_event) {
+   return sizeof _event + _event.message.size() + _event.function.size() +
+          _event.subsystem_string.size() + _event.time_string.size();
+}
+} // namespace
+
+const std::chrono::milliseconds SuS::logfile::retry_scheduler::s_tick{100};
+const std::chrono::seconds SuS::logfile::retry_scheduler::s_max_backoff{300};
+const size_t SuS::logfile::retry_scheduler::s_batch_size = 256U;
+
+SuS::logfile::retry_scheduler::retry_scheduler()
+   : m_wheel(s_wheel_slots),
+     m_random(unsigned(clock::now().time_since_epoch().count())),
+     m_thread(&retry_scheduler::run, this) {
+} // retry_scheduler constructor
+
+SuS::logfile::retry_scheduler::~retry_scheduler() {
+   stop();
+} // retry_scheduler destructor
+
+bool SuS::logfile::retry_scheduler::divert(
+      output_stream *_stream, const log_event &_event) {
+   // the circuits of most sinks are closed most of the time.
+   if (!_stream->m_d->m_retrying.load(std::memory_order_acquire)) {
+      return false;
+   }
+   std::lock_guard<std::mutex> lk(m_mutex);
+   const auto i = m_sinks.find(_stream);
+   if (i == m_sinks.end()) {
+      return false;
+   }
+   push(_stream, i->second, _event);
+   return true;
+} // retry_scheduler::divert
+
+void SuS::logfile::retry_scheduler::failed(
+      output_stream *_stream, const log_event &_event) {
+   const auto base = _stream->retry_time();
+   std::lock_guard<std::mutex> lk(m_mutex);
+   auto &state = m_sinks[_stream];
+   if (!state.generation) {
+      init(_stream, state);
+   }
+   push(_stream, state, _event);
+   if (state.generation) {
+      // already open. only the log thread opens circuits, and it diverts
+      // all events of an open circuit, so this should not happen.
+      return;
+   }
+   state.generation = ++m_generation;
+   _stream->m_d->m_retrying = true;
+   std::cout << "retrying delivery to " << _stream->name() << std::endl;
+   schedule(_stream, state, backoff(base, 0U));
+} // retry_scheduler::failed
+
+bool SuS::logfile::retry_scheduler::active() {
+   std::lock_guard<std::mutex> lk(m_mutex);
+   return std::any_of(m_sinks.cbegin(), m_sinks.cend(),
+         [](const std::pair<output_stream *const, sink_state> &_sink) {
+            return _sink.second.spool_path.empty();
+         });
+} // retry_scheduler::active
+
+void SuS::logfile::retry_scheduler::attach(output_stream *_stream) {
+   if (_stream->m_d->m_spool_path.empty()) {
+      return;
+   }
+   // the file is scanned when it is opened => not with m_mutex held.
+   std::unique_ptr<retry_spool> file;
+   try {
+      file.reset(new retry_spool{_stream->m_d->m_spool_path});
+   } catch (const std::exception &e) {
+      std::cerr << e.what() << std::endl;
+      return;
+   }
+   if (file->begin() == file->end()) {
+      return;
+   }
+   std::lock_guard<std::mutex> lk(m_mutex);
+   if (m_sinks.count(_stream)) {
+      return;
+   }
+   // events left over => deliver them before anything new.
+   auto &s = m_sinks[_stream];
+   init(_stream, s);
+   s.spool = std::move(file);
+   s.spool_next = s.spool->begin();
+   s.spool_end = s.spool->end();
+   s.generation = ++m_generation;
+   _stream->m_d->m_retrying = true;
+   std::cout << "retrying delivery to " << _stream->name() << " from "
+             << s.spool_path << std::endl;
+   schedule(_stream, s, s_tick);
+} // retry_scheduler::attach
+
+void SuS::logfile::retry_scheduler::metrics(
+      output_stream *_stream, logger_metrics::sink &_metrics) {
+   std::lock_guard<std::mutex> lk(m_mutex);
+   const auto s = m_stats.find(_stream);
+   if (s != m_stats.end()) {
+      _metrics.retried = s->second.retried;
+      _metrics.expired = s->second.expired;
+      _metrics.evicted = s->second.evicted;
+   }
+   const auto i = m_sinks.find(_stream);
+   if (i != m_sinks.end()) {
+      const auto &state = i->second;
+      _metrics.retry_queue_entries =
+            state.events.size() + state.unspooled.size();
+      _metrics.retry_queue_bytes = state.memory + state.unspooled_memory;
+      if (!state.events.empty()) {
+         _metrics.oldest_retry_age =
+               std::chrono::duration_cast<std::chrono::seconds>(
+                     std::chrono::system_clock::now() -
+                     state.events.front().event.time)
+                     .count();
+      }
+      _metrics.retry_spool_bytes = size_t(state.spool_end - state.spool_next);
+   }
+} // retry_scheduler::metrics
+
+void SuS::logfile::retry_scheduler::forget(output_stream *_stream) {
+   std::unique_lock<std::mutex> lk(m_mutex);
+   m_cv.wait(lk, [this, _stream]() { return m_busy != _stream; });
+   // its timer is ignored, since the state is gone.
+   m_sinks.erase(_stream);
+   m_stats.erase(_stream);
+   _stream->m_d->m_retrying = false;
+} // retry_scheduler::forget
+
+void SuS::logfile::retry_scheduler::stop() {
+   {
+      std::lock_guard<std::mutex> lk(m_mutex);
+      if (m_stop) {
+         return;
+      }
+      m_stop = true;
+   }
+   m_cv.notify_all();
+   m_thread.join();
+} // retry_scheduler::stop
+
+void SuS::logfile::retry_scheduler::init(
+      output_stream *_stream, sink_state &_state) {
+   _state.memory_limit = _stream->m_d->m_retry_memory_limit;
+   _state.expiry = _stream->m_d->m_retry_expiry;
+   _state.stats = &m_stats[_stream];
+   // the file is opened by the scheduler thread.
+   _state.spool_path = _stream->m_d->m_spool_path;
+   _state.spool_memory_limit = _stream->m_d->m_spool_memory_limit;
+} // retry_scheduler::init
+
+void SuS::logfile::retry_scheduler::push(
+      output_stream *_stream, sink_state &_state, const log_event &_event) {
+   if (_state.spool_path.empty()) {
+      push_memory(_stream, _state, _event, 0U);
+      return;
+   }
+   // the disk might be slow => the scheduler thread appends it to the file.
+   const auto size = event_size(_event);
+   if (_state.memory_limit &&
+         (_state.unspooled_memory + size > _state.memory_limit)) {
+      // the file does not keep up. the events waiting for it are older and
+      // evicting them would reorder the file => drop this one.
+      if (!_state.evicted) {
+         std::cerr << "retry queue of logger \"" << _stream->name()
+                   << "\" is full, dropping entries" << std::endl;
+      }
+      ++_state.evicted;
+      ++_state.stats->evicted;
+      return;
+   }
+   if (_state.unspooled.empty()) {
+      m_unspooled.push_back(_stream);
+      m_cv.notify_all();
+   }
+   _state.unspooled.push_back(_event);
+   _state.unspooled_memory += size;
+} // retry_scheduler::push
+
+void SuS::logfile::retry_scheduler::spool(std::unique_lock<std::mutex> &_lk,
+      output_stream *_stream, sink_state &_state) {
+   std::deque<log_event> events;
+   events.swap(_state.unspooled);
+   if (events.empty()) {
+      return;
+   }
+   // only this thread touches the file, and the state stays while the sink
+   // is busy => write without the lock. the events stay accounted in
+   // unspooled_memory meanwhile, to keep the log thread within the limit.
+   _lk.unlock();
+   auto &file = _state.spool;
+   const auto opened = !file && !_state.spool_path.empty();
+   if (opened) {
+      try {
+         file.reset(new retry_spool{_state.spool_path});
+      } catch (const std::exception &e) {
+         // better keep the events in memory than drop them.
+         std::cerr << e.what() << std::endl;
+      }
+   }
+   const auto begin = file ? file->begin() : 0U;
+   const auto end = file ? file->end() : 0U;
+   // the end of the file behind every event appended.
+   std::vector<uint64_t> ends;
+   if (file) {
+      try {
+         for (const auto &i : events) {
+            file->append(i);
+            ends.push_back(file->end());
+         }
+      } catch (const std::exception &e) {
+         std::cerr << e.what() << std::endl;
+      }
+   }
+   _lk.lock();
+
+   if (opened) {
+      if (file) {
+         _state.spool_next = begin;
+         _state.spool_end = end;
+      } else {
+         _state.spool_path.clear();
+      }
+   }
+   for (size_t n = 0U; n < events.size(); ++n) {
+      const auto &event = events[n];
+      const auto size = event_size(event);
+      _state.unspooled_memory -= size;
+      if (!file) {
+         push_memory(_stream, _state, event, 0U);
+         continue;
+      }
+      if (n < ends.size()) {
+         // events only in the file must not be overtaken.
+         if ((_state.spool_next == _state.spool_end) &&
+               (_state.memory + size <= _state.spool_memory_limit)) {
+            push_memory(_stream, _state, event, _state.spool_end);
+            _state.spool_next = ends[n];
+         }
+         _state.spool_end = ends[n];
+         continue;
+      }
+      // e.g. the disk is full => keep it in memory, even if that makes it
+      // overtake events only in the file.
+      if (_state.memory_limit &&
+            (_state.memory + size > _state.memory_limit)) {
+         // the events in memory are in the file as well and evicting them
+         // would replay them out of order after a restart => drop this one.
+         ++_state.evicted;
+         ++_state.stats->evicted;
+         continue;
+      }
+      push_memory(_stream, _state, event, _state.spool_next);
+   }
+} // retry_scheduler::spool
+
+void SuS::logfile::retry_scheduler::push_memory(output_stream *_stream,
+      sink_state &_state, const log_event &_event, uint64_t _offset) {
+   _state.events.push_back(queued_event{_event, _offset});
+   _state.by_level[_event.level].push_back(std::prev(_state.events.end()));
+   _state.memory += event_size(_event);
+   // with a spool, the memory is limited by spool_memory_limit (see spool).
+   if (_state.spool_path.empty() && _state.memory_limit &&
+         (_state.memory > _state.memory_limit)) {
+      evict(_stream, _state);
+   }
+} // retry_scheduler::push_memory
+
+void SuS::logfile::retry_scheduler::evict(
+      output_stream *_stream, sink_state &_state) {
+   if (!_state.evicted) {
+      std::cerr << "retry queue of logger \"" << _stream->name()
+                << "\" is full, dropping entries" << std::endl;
+   }
+   // the levels are ordered by severity.
+   auto level = _state.by_level.begin();
+   while ((_state.memory > _state.memory_limit) &&
+         (level != _state.by_level.end())) {
+      auto &fifo = level->second;
+      // the front may be being written right now.
+      const auto skip = (m_busy == _stream) && !fifo.empty() &&
+                        (fifo.front() == _state.events.begin());
+      if (fifo.size() <= size_t(skip)) {
+         ++level;
+         continue;
+      }
+      const auto i = fifo[skip];
+      fifo.erase(fifo.begin() + skip);
+      _state.memory -= event_size(i->event);
+      _state.events.erase(i);
+      ++_state.evicted;
+      ++_state.stats->evicted;
+   }
+} // retry_scheduler::evict
+
+bool SuS::logfile::retry_scheduler::is_expired(const sink_state &_state,
+      const log_event &_event, std::chrono::system_clock::time_point _now) {
+   const auto i = _state.expiry.find(_event.level);
+   return (i != _state.expiry.end()) &&
+          (std::chrono::duration_cast<std::chrono::seconds>(_now - _event.time)
+                      .count() > i->second);
+} // retry_scheduler::is_expired
+
+void SuS::logfile::retry_scheduler::load(std::unique_lock<std::mutex> &_lk,
+      output_stream *_stream, sink_state &_state) {
+   const auto tpnow = std::chrono::system_clock::now();
+   auto expired = 0U;
+   auto offset = _state.spool_next;
+   auto memory = _state.memory;
+   // the log thread leaves the file and the events in memory of a sink with
+   // a spool to this thread => read without the lock.
+   _lk.unlock();
+   std::vector<queued_event> loaded;
+   log_event event;
+   while (loaded.empty() || (memory < _state.spool_memory_limit)) {
+      const auto start = offset;
+      if (!_state.spool->read(offset, event)) {
+         break;
+      }
+      if (is_expired(_state, event, tpnow)) {
+         ++expired;
+         continue;
+      }
+      memory += event_size(event);
+      loaded.push_back(queued_event{std::move(event), start});
+   }
+   const auto end = _state.spool->end();
+   _lk.lock();
+
+   for (const auto &i : loaded) {
+      push_memory(_stream, _state, i.event, i.spool_offset);
+   }
+   // the spool cut off broken records when it was opened, so reading only
+   // fails at the end, unless the disk fails => give up on the rest then.
+   _state.spool_next = (offset == _state.spool_next) ? end : offset;
+   _state.stats->expired += expired;
+   if (expired > 0)
+      std::cerr << "expired " << expired << " spooled entries for logger \""
+                << _stream->name() << "\"" << std::endl;
+} // retry_scheduler::load
+
+void SuS::logfile::retry_scheduler::acknowledge(
+      std::unique_lock<std::mutex> &_lk, sink_state &_state) {
+   if (!_state.spool) {
+      return;
+   }
+   const auto offset = _state.events.empty()
+                             ? _state.spool_next
+                             : _state.events.front().spool_offset;
+   _lk.unlock();
+   _state.spool->commit(offset);
+   const auto end = _state.spool->end();
+   _lk.lock();
+   if (end != _state.spool_end) {
+      // everything was delivered and the file truncated.
+      _state.spool_next = _state.spool_end = end;
+   }
+} // retry_scheduler::acknowledge
+
+bool SuS::logfile::retry_scheduler::drained(const sink_state &_state) {
+   return _state.events.empty() && _state.unspooled.empty() &&
+          (_state.spool_next == _state.spool_end);
+} // retry_scheduler::drained
+
+void SuS::logfile::retry_scheduler::pop(sink_state &_state) {
+   // the oldest event overall is the oldest one of its level.
+   auto &fifo = _state.by_level[_state.events.front().event.level];
+   fifo.pop_front();
+   _state.memory -= event_size(_state.events.front().event);
+   _state.events.pop_front();
+} // retry_scheduler::pop
+
+void SuS::logfile::retry_scheduler::expire(
+      output_stream *_stream, sink_state &_state) {
+   const auto tpnow = std::chrono::system_clock::now();
+   auto expired = 0U;
+   for (auto &i : _state.by_level) {
+      auto &fifo = i.second;
+      while (!fifo.empty() && is_expired(_state, fifo.front()->event, tpnow)) {
+         _state.memory -= event_size(fifo.front()->event);
+         _state.events.erase(fifo.front());
+         fifo.pop_front();
+         ++expired;
+      }
+   }
+   _state.stats->expired += expired;
+   if (expired > 0)
+      std::cerr << "expired " << expired << " entries for logger \""
+                << _stream->name() << "\"" << std::endl;
+} // retry_scheduler::expire
+
+void SuS::logfile::retry_scheduler::schedule(
+      output_stream *_stream, sink_state &_state, clock::duration _delay) {
+   if (!m_pending_timers) {
+      // the wheel stood still => restart it from now.
+      m_next_tick = clock::now() + s_tick;
+   }
+   const auto ticks = std::max<size_t>(
+         1U, size_t((_delay + s_tick - clock::duration{1}) / s_tick));
+   m_wheel[(m_cursor + ticks - 1U) % s_wheel_slots].push_back(
+         timer{_stream, _state.generation, (ticks - 1U) / s_wheel_slots});
+   ++m_pending_timers;
+   m_cv.notify_all();
+} // retry_scheduler::schedule
+
+SuS::logfile::retry_scheduler::clock::duration
+SuS::logfile::retry_scheduler::backoff(unsigned _base_s, unsigned _failures) {
+   const auto base = std::chrono::duration_cast<clock::duration>(
+         std::chrono::seconds(std::max(_base_s, 1U)));
+   // the first probe typically only makes the sink start reconnecting, and
+   // retry_time() already accounts for that => start doubling after the
+   // second failed probe.
+   const auto doublings = (_failures > 1U) ? std::min(_failures - 1U, 10U) : 0U;
+   const auto delay =
+         std::min<clock::duration>(base * (1U << doublings), s_max_backoff);
+   std::uniform_int_distribution<clock::rep> jitter(0, delay.count() / 4);
+   return delay + clock::duration(jitter(m_random));
+} // retry_scheduler::backoff
+
+void SuS::logfile::retry_scheduler::replay(
+      output_stream *_stream, unsigned long _generation) {
+   std::unique_lock<std::mutex> lk(m_mutex);
+   const auto i = m_sinks.find(_stream);
+   if ((i == m_sinks.end()) || (i->second.generation != _generation)) {
+      // forgotten in the meantime.
+      return;
+   }
+   auto &state = i->second;
+   expire(_stream, state);
+   m_busy = _stream;
+
+   // the first write is the probe. the events stay queued until they have
+   // been written, and only this thread removes them, so the reference to
+   // the front stays valid without the lock.
+   auto ok = true;
+   size_t n = 0U;
+   for (; n < s_batch_size; ++n) {
+      if (state.events.empty() && (state.spool_next == state.spool_end)) {
+         // the file is read up => the events not written yet are next.
+         spool(lk, _stream, state);
+      }
+      if (state.events.empty() && (state.spool_next != state.spool_end)) {
+         load(lk, _stream, state);
+      }
+      if (state.events.empty()) {
+         break;
+      }
+      const auto &event = state.events.front().event;
+      lk.unlock();
+      ok = _stream->write(event);
+      lk.lock();
+      if (!ok) {
+         break;
+      }
+      ++state.stats->retried;
+      pop(state);
+   }
+   auto base = 0U;
+   if (!ok) {
+      // still busy => forget() cannot remove the state meanwhile.
+      lk.unlock();
+      base = _stream->retry_time();
+      lk.lock();
+   }
+   acknowledge(lk, state);
+   m_busy = nullptr;
+   m_cv.notify_all();
+
+   if (drained(state)) {
+      std::cout << "delivery to " << _stream->name() << " resumed";
+      if (state.evicted) {
+         std::cout << ", " << state.evicted << " entries dropped";
+      }
+      std::cout << std::endl;
+      m_sinks.erase(i);
+      _stream->m_d->m_retrying.store(false, std::memory_order_release);
+      return;
+   }
+   if (ok) {
+      // more to replay => give the other sinks a turn first.
+      state.failures = 0U;
+      m_ready.emplace_back(_stream, _generation);
+      return;
+   }
+   // a failure after some successful writes starts a new outage.
+   state.failures = n ? 0U : state.failures + 1U;
+   schedule(_stream, state, backoff(base, state.failures));
+} // retry_scheduler::replay
+
+void SuS::logfile::retry_scheduler::run() {
+   crash_log::install_signal_stack();
+// same as log_thread::run.
+#if defined HAVE_PRCTL && defined PR_GET_NAME
+   char threadname[17];
+   ::prctl(PR_GET_NAME, threadname, 0, 0, 0);
+   threadname[16] = '\0';
+   ::strncat(threadname, " (retry)", 16 - ::strlen(threadname));
+   ::prctl(PR_SET_NAME, threadname, 0, 0, 0);
+#endif
+
+   std::unique_lock<std::mutex> lk(m_mutex);
+   const auto spool_front = [this, &lk]() {
+      const auto stream = m_unspooled.front();
+      m_unspooled.pop_front();
+      const auto i = m_sinks.find(stream);
+      if (i == m_sinks.end()) {
+         // forgotten in the meantime.
+         return;
+      }
+      m_busy = stream;
+      spool(lk, stream, i->second);
+      m_busy = nullptr;
+      m_cv.notify_all();
+   };
+   while (!m_stop) {
+      if (m_pending_timers && (clock::now() >= m_next_tick)) {
+         // move the sinks whose timers expire in this slot to m_ready.
+         auto &slot = m_wheel[m_cursor];
+         auto keep = slot.begin();
+         for (auto &t : slot) {
+            if (t.rounds) {
+               --t.rounds;
+               *keep++ = t;
+               continue;
+            }
+            --m_pending_timers;
+            m_ready.emplace_back(t.stream, t.generation);
+         }
+         slot.erase(keep, slot.end());
+         m_cursor = (m_cursor + 1U) % s_wheel_slots;
+         m_next_tick += s_tick;
+         continue;
+      }
+      if (!m_unspooled.empty()) {
+         spool_front();
+         continue;
+      }
+      if (!m_ready.empty()) {
+         const auto next = m_ready.front();
+         m_ready.pop_front();
+         lk.unlock();
+         replay(next.first, next.second);
+         lk.lock();
+         continue;
+      }
+      if (m_pending_timers) {
+         m_cv.wait_until(lk, m_next_tick);
+      } else {
+         m_cv.wait(lk);
+      }
+   }
+   // what was diverted last is delivered after a restart.
+   while (!m_unspooled.empty()) {
+      spool_front();
+   }
+} // retry_scheduler::run
@@ -0,0 +1,263 @@
+/* SPDX-License-Identifier: MIT */
+/*! @file */
+#pragma once
+
+#include "log_event.h"
+#include "logger_metrics.h"
+#include "retry_spool.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace SuS {
+namespace logfile {
+
+class output_stream;
+
+//! Retries the delivery to failed sinks for all sinks from one thread.
+/*!
+ * Every sink has a circuit breaker:
+ * - closed: the log thread writes to the sink directly. This is the normal
+ *   state, in which the scheduler knows nothing about the sink.
+ * - open: a write failed. New events are queued here instead of being
+ *   written, until the retry timer of the sink expires.
+ * - half open: the timer expired. The oldest event is written as a probe.
+ *   If that fails, the circuit opens again with a longer delay. Otherwise
+ *   the queue is replayed in batches of \ref s_batch_size, taking turns
+ *   with the other sinks being replayed. When the queue is empty, the
+ *   circuit closes.
+ *
+ * The delay before a probe is output_stream::retry_time(), doubled for
+ * every further failed probe in a row (up to \ref s_max_backoff), plus up
+ * to 25 % random jitter, so that sinks failing together do not retry in
+ * lockstep.
+ *
+ * The timers are kept in a timer wheel with a resolution of \ref s_tick.
+ * The thread sleeps while no timer is pending.
+ *
+ * Events expire after a time depending on their level (see
+ * output_stream::set_retry_expiry). For every level, the queued events are
+ * also kept in a FIFO in order of their time stamp, so expiring only looks
+ * at the events that are actually due. The same FIFOs make it cheap to
+ * evict the oldest event of the lowest level, when the queue exceeds the
+ * memory limit of the sink (see output_stream::set_retry_memory_limit).
+ * Events of sinks with a spool file are never evicted: they would be
+ * replayed from the file after a restart, out of order.
+ *
+ * A sink can have a spool file (see output_stream::set_retry_spool). Then
+ * every queued event is appended to the file, and only the oldest ones, up
+ * to a memory limit, are kept in memory as well. The rest is read back
+ * sequentially while the queue is replayed. What has been delivered is
+ * committed to the file after every batch. The file is only accessed by the
+ * scheduler thread and without m_mutex, so that a slow disk holds up
+ * neither the log thread nor the other sinks. The log thread just hands the
+ * events over, up to the memory limit of the sink.
+ *
+ * Only the log thread may open a circuit. Since the scheduler writes to a
+ * sink only while its circuit is not closed, and the log thread only while
+ * it is closed, every sink is written from one thread at a time. Whether
+ * the circuit is closed is also flagged in the sink, so that \ref divert
+ * does not take m_mutex then.
+ */
+class retry_scheduler {
+ public:
+   retry_scheduler();
+   retry_scheduler(const retry_scheduler &) = delete;
+   retry_scheduler &operator=(const retry_scheduler &) = delete;
+   ~retry_scheduler();
+
+   //! Queue _event, if the circuit of _stream is not closed.
+   /*!
+    * @return True, if the event has been queued. False, if it has to be
+    *    written to the sink directly.
+    */
+   bool divert(output_stream *_stream, const log_event &_event);
+
+   //! Open the circuit of _stream after writing _event failed.
+   void failed(output_stream *_stream, const log_event &_event);
+
+   //! Check, if events are waiting for delivery.
+   /*!
+    * Events in a spool file do not count: they are delivered after a
+    * restart as well.
+    */
+   bool active();
+
+   //! Resume the delivery of events spooled by an earlier run.
+   /*!
+    * Called when _stream is added to the logger.
+    */
+   void attach(output_stream *_stream);
+
+   //! Fill in the retry counters and queue sizes of _stream.
+   void metrics(output_stream *_stream, logger_metrics::sink &_metrics);
+
+   //! Drop everything queued for _stream, e.g. before it is deleted.
+   /*!
+    * Waits for a write to _stream in progress.
+    */
+   void forget(output_stream *_stream);
+
+   //! Stop the thread. Queued events are dropped, unless they are waiting
+   //! for the spool file: they are appended to it first.
+   void stop();
+
+   //! Time resolution of the timer wheel.
+   static const std::chrono::milliseconds s_tick;
+   //! Upper limit of the delay between two probes.
+   static const std::chrono::seconds s_max_backoff;
+   //! Maximum number of events replayed at once for one sink.
+   static const size_t s_batch_size;
+
+ private:
+   typedef std::chrono::steady_clock clock;
+
+   struct queued_event {
+      log_event event;
+      //! Offset in the spool file, if the sink has one.
+      uint64_t spool_offset;
+   };
+   typedef std::list<queued_event> queue_t;
+
+   //! Counters kept across outages.
+   struct sink_stats {
+      unsigned long evicted{0U};
+      unsigned long expired{0U};
+      unsigned long retried{0U};
+   };
+
+   struct sink_state {
+      //! The events in memory.
+      queue_t events;
+      //! For every level the events in order of their time stamp.
+      std::map<logger::log_level, std::deque<queue_t::iterator>> by_level;
+      //! Approximate size of the events in memory.
+      size_t memory{0U};
+      //! Copy of the settings of the sink.
+      size_t memory_limit{0U};
+      std::map<logger::log_level, std::time_t> expiry;
+      //! Events evicted in this outage.
+      unsigned long evicted{0U};
+      //! Points into m_stats.
+      sink_stats *stats{nullptr};
+      //! The spool file, opened by the scheduler thread. Null, if the sink
+      //! has none. Only used by the scheduler thread.
+      std::unique_ptr<retry_spool> spool;
+      //! Path of the spool file. Empty, if the sink has none or it could
+      //! not be opened.
+      std::string spool_path;
+      //! Events diverted by the log thread, not in the spool file yet.
+      std::deque<log_event> unspooled;
+      //! Approximate size of the unspooled events.
+      size_t unspooled_memory{0U};
+      //! Offset of the first spooled event not in memory.
+      uint64_t spool_next{0U};
+      //! Offset behind the last spooled event, i.e. spool->end().
+      uint64_t spool_end{0U};
+      //! Above this size, spooled events are only kept in the file.
+      size_t spool_memory_limit{0U};
+      //! Failed probes in a row.
+      unsigned failures{0U};
+      //! Unique for every opening of the circuit, to ignore stale timers.
+      unsigned long generation{0U};
+   };
+
+   struct timer {
+      output_stream *stream;
+      unsigned long generation;
+      //! Remaining turns of the wheel.
+      size_t rounds;
+   };
+
+   //! Take over the settings of _stream. m_mutex must be held.
+   void init(output_stream *_stream, sink_state &_state);
+   //! Queue _event. m_mutex must be held.
+   void push(
+         output_stream *_stream, sink_state &_state, const log_event &_event);
+   //! Append the unspooled events of _stream to its spool file.
+   /*!
+    * Called with m_mutex held, it is released while writing. m_busy must
+    * be _stream.
+    */
+   void spool(std::unique_lock<std::mutex> &_lk, output_stream *_stream,
+         sink_state &_state);
+   //! Queue _event in memory. m_mutex must be held.
+   void push_memory(output_stream *_stream, sink_state &_state,
+         const log_event &_event, uint64_t _offset);
+   //! Drop events until the memory limit is kept. m_mutex must be held.
+   void evict(output_stream *_stream, sink_state &_state);
+   //! Check, if _event is too old for retrying. m_mutex must be held.
+   static bool is_expired(const sink_state &_state, const log_event &_event,
+         std::chrono::system_clock::time_point _now);
+   //! Read spooled events into memory.
+   /*!
+    * Called with m_mutex held, it is released while reading. m_busy must
+    * be _stream.
+    */
+   void load(std::unique_lock<std::mutex> &_lk, output_stream *_stream,
+         sink_state &_state);
+   //! Persist, which spooled events are gone.
+   /*!
+    * Called with m_mutex held, it is released while writing. m_busy must
+    * be the sink.
+    */
+   void acknowledge(std::unique_lock<std::mutex> &_lk, sink_state &_state);
+   //! Check, if nothing is left to deliver. m_mutex must be held.
+   static bool drained(const sink_state &_state);
+   //! Remove the oldest event. m_mutex must be held.
+   void pop(sink_state &_state);
+   //! Drop expired events. m_mutex must be held.
+   void expire(output_stream *_stream, sink_state &_state);
+   //! Arm the timer of _stream. m_mutex must be held.
+   void schedule(output_stream *_stream, sink_state &_state,
+         clock::duration _delay);
+   //! Delay before the next probe. m_mutex must be held.
+   /*!
+    * @param _base_s The retry_time() of the sink. Not called here, since
+    *    sinks may take their own locks.
+    */
+   clock::duration backoff(unsigned _base_s, unsigned _failures);
+   //! Probe and replay one batch. Called without m_mutex.
+   void replay(output_stream *_stream, unsigned long _generation);
+
+   //! Main function of the thread.
+   void run();
+
+   std::mutex m_mutex;
+   std::condition_variable m_cv;
+   std::map<output_stream *, sink_state> m_sinks;
+   std::map<output_stream *, sink_stats> m_stats;
+   unsigned long m_generation{0U};
+   //! The sink being written to outside of m_mutex, or its spool file.
+   output_stream *m_busy{nullptr};
+   //! Sinks with unspooled events, in the order they got them.
+   std::deque<output_stream *> m_unspooled;
+
+   std::vector<std::vector<timer>> m_wheel;
+   size_t m_cursor{0U};
+   size_t m_pending_timers{0U};
+   //! When the slot at m_cursor is due.
+   clock::time_point m_next_tick;
+   //! Sinks to replay now, in round-robin order: their timer expired, or
+   //! their last batch was successful and more events are waiting.
+   std::deque<std::pair<output_stream *, unsigned long>> m_ready;
+
+   std::minstd_rand m_random;
+   bool m_stop{false};
+   std::thread m_thread;
+}; // class retry_scheduler
+
+} // namespace logfile
+} // namespace SuS
@@ -0,0 +1,322 @@
+/* SPDX-License-Identifier: MIT */
+#include "retry_spool.h"
+
+#include "config.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+#include <string.h>
+
+#if defined HAVE_UNISTD_H && defined HAVE_FCNTL_H
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+const char s_magic[8] = {'S', 'u', 'S', 's', 'p', 'o', 'o', 'l'};
+//! Magic and the offset of the first event not delivered.
+const uint64_t s_header_size = sizeof s_magic + sizeof(uint64_t);
+//! Length and checksum of the payload.
+const size_t s_record_header_size = 2U * sizeof(uint32_t);
+//! Records longer than this are considered garbage.
+const uint32_t s_max_record_size = 64U * 1024U * 1024U;
+const size_t s_read_ahead = 64U * 1024U;
+
+std::string system_error(const std::string &_what, const std::string &_path) {
+   return _what + " " + _path + ": " + ::strerror(errno);
+}
+
+//! FNV-1a, good enough to detect torn writes.
+uint32_t checksum(const char *_data, size_t _len) {
+   uint32_t h = 2166136261U;
+   for (size_t i = 0U; i < _len; ++i) {
+      h = (h ^ uint8_t(_data[i])) * 16777619U;
+   }
+   return h;
+}
+
+template <typename T>
+void put(std::string &_out, T _value) {
+   _out.append(reinterpret_cast<const char *>(&_value), sizeof _value);
+}
+
+void put_string(std::string &_out, const std::string &_s) {
+   put(_out, uint32_t(_s.size()));
+   _out.append(_s);
+}
+
+template <typename T>
+bool get(const char *&_p, const char *_end, T &_value) {
+   if (size_t(_end - _p) < sizeof _value) {
+      return false;
+   }
+   ::memcpy(&_value, _p, sizeof _value);
+   _p += sizeof _value;
+   return true;
+}
+
+bool get_string(const char *&_p, const char *_end, std::string &_s) {
+   uint32_t len;
+   if (!get(_p, _end, len) || (size_t(_end - _p) < len)) {
+      return false;
+   }
+   _s.assign(_p, len);
+   _p += len;
+   return true;
+}
+
+bool truncate_to(int _fd, uint64_t _len) {
+   return ::ftruncate(_fd, off_t(_len)) == 0;
+}
+
+bool write_all(int _fd, const char *_data, size_t _len, uint64_t _offset) {
+   while (_len) {
+      const auto n = ::pwrite(_fd, _data, _len, off_t(_offset));
+      if (n < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+         return false;
+      }
+      _data += n;
+      _len -= size_t(n);
+      _offset += uint64_t(n);
+   }
+   return true;
+}
+} // namespace
+
+SuS::logfile::retry_spool::retry_spool(const std::string &_path)
+   : m_path(_path), m_begin(s_header_size), m_end(s_header_size),
+     m_run_begin(s_header_size) {
+   m_fd = ::open(m_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+   if (m_fd < 0) {
+      throw std::runtime_error{system_error("Cannot open", m_path)};
+   }
+   struct ::stat st;
+   if (::fstat(m_fd, &st) != 0) {
+      const auto error = system_error("Cannot stat", m_path);
+      ::close(m_fd);
+      throw std::runtime_error{error};
+   }
+   const auto size = uint64_t(st.st_size);
+   if (size < s_header_size) {
+      // new, or the header itself got torn => nothing to recover.
+      if (!truncate_to(m_fd, 0U) ||
+            !write_all(m_fd, s_magic, sizeof s_magic, 0U)) {
+         const auto error = system_error("Cannot initialize", m_path);
+         ::close(m_fd);
+         throw std::runtime_error{error};
+      }
+      write_header();
+      return;
+   }
+
+   char header[s_header_size];
+   if ((::pread(m_fd, header, sizeof header, 0) != off_t(sizeof header)) ||
+         (::memcmp(header, s_magic, sizeof s_magic) != 0)) {
+      ::close(m_fd);
+      throw std::runtime_error{"Not a retry spool: " + m_path};
+   }
+   ::memcpy(&m_begin, header + sizeof s_magic, sizeof m_begin);
+   if ((m_begin < s_header_size) || (m_begin > size)) {
+      // the data behind the header did not make it to the disk.
+      m_begin = s_header_size;
+   }
+
+   // find the end of the last complete record. a crash might have left a
+   // partial one behind.
+   m_end = size;
+   auto offset = m_begin;
+   log_event event;
+   while (read(offset, event)) {
+   }
+   m_end = offset;
+   m_run_begin = m_end;
+   if (m_end != size) {
+      if (!truncate_to(m_fd, m_end)) {
+         const auto error = system_error("Cannot truncate", m_path);
+         ::close(m_fd);
+         throw std::runtime_error{error};
+      }
+   }
+   commit(m_begin);
+} // retry_spool constructor
+
+SuS::logfile::retry_spool::~retry_spool() {
+   ::close(m_fd);
+} // retry_spool destructor
+
+uint64_t SuS::logfile::retry_spool::append(const log_event &_event) {
+   std::string record(s_record_header_size, '\0');
+   put(record, uint8_t(_event.level));
+   put(record, uint32_t(_event.subsystem));
+   put(record, int64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             _event.time.time_since_epoch())
+                             .count()));
+   put(record, uint32_t(_event.sample_rate));
+   put_string(record, _event.message);
+   put_string(record, _event.function);
+   put_string(record, _event.subsystem_string);
+   // last, so that records written before it was added can still be read.
+   put(record, int64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             _event.submit_time.time_since_epoch())
+                             .count()));
+
+   const auto len = uint32_t(record.size() - s_record_header_size);
+   const auto sum = checksum(record.data() + s_record_header_size, len);
+   ::memcpy(&record[0], &len, sizeof len);
+   ::memcpy(&record[sizeof len], &sum, sizeof sum);
+
+   if (!write_all(m_fd, record.data(), record.size(), m_end)) {
+      const auto error = system_error("Cannot write to", m_path);
+      // do not leave a partial record behind. if that fails as well, it is
+      // cut off when the file is opened the next time.
+      truncate_to(m_fd, m_end);
+      throw std::runtime_error{error};
+   }
+   const auto ret = m_end;
+   m_end += record.size();
+   return ret;
+} // retry_spool::append
+
+bool SuS::logfile::retry_spool::read(uint64_t &_offset, log_event &_event) {
+   if (_offset + s_record_header_size > m_end) {
+      return false;
+   }
+   // make sure that [_offset, _offset + _len) is in the buffer.
+   const auto fill = [this](uint64_t _from, size_t _len) -> bool {
+      if ((_from >= m_buffer_offset) &&
+            (_from + _len <= m_buffer_offset + m_buffer.size())) {
+         return true;
+      }
+      const auto want = size_t(std::min<uint64_t>(
+            std::max(_len, s_read_ahead), m_end - _from));
+      m_buffer.resize(want);
+      m_buffer_offset = _from;
+      auto got = size_t{0U};
+      while (got < want) {
+         const auto n = ::pread(m_fd, m_buffer.data() + got, want - got,
+               off_t(_from + got));
+         if (n < 0 && errno == EINTR) {
+            continue;
+         }
+         if (n <= 0) {
+            break;
+         }
+         got += size_t(n);
+      }
+      m_buffer.resize(got);
+      return got >= _len;
+   };
+
+   if (!fill(_offset, s_record_header_size)) {
+      return false;
+   }
+   uint32_t len, sum;
+   const auto header = m_buffer.data() + (_offset - m_buffer_offset);
+   ::memcpy(&len, header, sizeof len);
+   ::memcpy(&sum, header + sizeof len, sizeof sum);
+   if ((len > s_max_record_size) ||
+         (_offset + s_record_header_size + len > m_end) ||
+         !fill(_offset, s_record_header_size + len)) {
+      return false;
+   }
+   const char *p =
+         m_buffer.data() + (_offset - m_buffer_offset) + s_record_header_size;
+   const auto end = p + len;
+   if (checksum(p, len) != sum) {
+      return false;
+   }
+
+   uint8_t level;
+   uint32_t subsystem;
+   int64_t time;
+   uint32_t sample_rate;
+   if (!get(p, end, level) || !get(p, end, subsystem) || !get(p, end, time) ||
+         !get(p, end, sample_rate) ||
+         (level > uint8_t(logger::log_level::severe)) ||
+         !get_string(p, end, _event.message) ||
+         !get_string(p, end, _event.function) ||
+         !get_string(p, end, _event.subsystem_string)) {
+      return false;
+   }
+   int64_t submit_time;
+   if ((_offset >= m_run_begin) && get(p, end, submit_time)) {
+      // spilled during this run => the latency is measured from the
+      // original submission.
+      _event.submit_time = std::chrono::steady_clock::time_point(
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                  std::chrono::nanoseconds(submit_time)));
+   } else {
+      // the steady clock of an earlier run means nothing here.
+      _event.submit_time = std::chrono::steady_clock::now();
+   }
+   _event.level = logger::log_level(level);
+   _event.subsystem = subsystem;
+   _event.sample_rate = sample_rate;
+   _event.time = std::chrono::system_clock::time_point(
+         std::chrono::duration_cast<std::chrono::system_clock::duration>(
+               std::chrono::nanoseconds(time)));
+   _event.time_string = format_time(_event.time);
+   _offset += s_record_header_size + len;
+   return true;
+} // retry_spool::read
+
+void SuS::logfile::retry_spool::commit(uint64_t _offset) {
+   m_begin = _offset;
+   if ((m_begin == m_end) && (m_end != s_header_size)) {
+      // everything delivered => start over. move the offset first, so that
+      // a crash in between does not replay anything.
+      m_begin = m_end = m_run_begin = s_header_size;
+      write_header();
+      truncate_to(m_fd, s_header_size);
+      m_buffer.clear();
+      m_buffer_offset = 0U;
+      return;
+   }
+   write_header();
+} // retry_spool::commit
+
+void SuS::logfile::retry_spool::write_header() {
+   // 8 aligned bytes => not torn in practice.
+   write_all(m_fd, reinterpret_cast<const char *>(&m_begin), sizeof m_begin,
+         sizeof s_magic);
+} // retry_spool::write_header
+
+#else
+SuS::logfile::retry_spool::retry_spool(const std::string &_path)
+   : m_path(_path), m_begin(0U), m_end(0U), m_run_begin(0U) {
+   throw std::runtime_error{"Retry spools are not supported here."};
+}
+
+SuS::logfile::retry_spool::~retry_spool() {
+}
+
+uint64_t SuS::logfile::retry_spool::append(const log_event &) {
+   return 0U;
+}
+
+bool SuS::logfile::retry_spool::read(uint64_t &, log_event &) {
+   return false;
+}
+
+void SuS::logfile::retry_spool::commit(uint64_t) {
+}
+
+void SuS::logfile::retry_spool::write_header() {
+}
+#endif
+
+uint64_t SuS::logfile::retry_spool::begin() const {
+   return m_begin;
+} // retry_spool::begin
+
+uint64_t SuS::logfile::retry_spool::end() const {
+   return m_end;
+} // retry_spool::end
+
+const std::string &SuS::logfile::retry_spool::path() const {
+   return m_path;
+} // retry_spool::path
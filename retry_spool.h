@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier: MIT */
+/*! @file */
+#pragma once
+
+#include "log_event.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace SuS {
+namespace logfile {
+
+//! Append-only file holding the retry queue of one sink.
+/*!
+ * The file starts with a header holding the offset of the first event that
+ * has not been delivered yet. Events are appended as records with a length
+ * and a checksum, so that a record torn by a crash is detected and cut off
+ * when the file is opened again.
+ *
+ * Delivered events are not removed one by one: \ref commit just moves the
+ * offset in the header. When everything has been delivered, the file is
+ * truncated to the header. A crash between delivering an event and
+ * committing it makes it be delivered again, never lost.
+ *
+ * The records are written in host byte order, the file is not meant to be
+ * moved to other machines.
+ *
+ * Not thread-safe.
+ */
+class retry_spool {
+ public:
+   //! Open or create the spool file.
+   /*!
+    * @throw std::runtime_error The file could not be opened or is not a
+    *    spool file.
+    */
+   explicit retry_spool(const std::string &_path);
+   retry_spool(const retry_spool &) = delete;
+   retry_spool &operator=(const retry_spool &) = delete;
+   ~retry_spool();
+
+   //! Append an event.
+   /*!
+    * @return The offset of the event in the file.
+    * @throw std::runtime_error Writing failed, e.g. because the disk is
+    *    full. The file is unchanged then.
+    */
+   uint64_t append(const log_event &_event);
+
+   //! Read the event at _offset.
+   /*!
+    * Meant for reading sequentially: the file is read ahead. Events
+    * appended by an earlier process get the current time as submit_time.
+    * @param _offset Offset of the event. Moved to the next event.
+    * @return False at the end of the file.
+    */
+   bool read(uint64_t &_offset, log_event &_event);
+
+   //! Declare all events before _offset as delivered.
+   void commit(uint64_t _offset);
+
+   //! Offset of the first event not delivered yet.
+   uint64_t begin() const;
+   //! Offset behind the last event.
+   uint64_t end() const;
+
+   const std::string &path() const;
+
+ private:
+   void write_header();
+
+   const std::string m_path;
+   int m_fd{-1};
+   uint64_t m_begin;
+   uint64_t m_end;
+   //! Records from here on were appended by this process.
+   uint64_t m_run_begin;
+
+   //! Read-ahead buffer, holding the file from m_buffer_offset on.
+   std::vector<char> m_buffer;
+   uint64_t m_buffer_offset{0U};
+}; // class retry_spool
+
+} // namespace logfile
+} // namespace SuS
@@ -0,0 +1,314 @@
+/* SPDX-License-Identifier: MIT */
+#include "stomp_frame_parser.h"
+
+#include <algorithm>
+#include <string.h>
+
+namespace {
+const char s_receipt_command[] = "RECEIPT";
+const char s_receipt_id_key[] = "receipt-id:";
+const char s_content_length_key[] = "content-length:";
+const char s_connected_command[] = "CONNECTED";
+// larger bodies are rejected, since the whole frame is buffered.
+const size_t s_max_content_length = 64U * 1024U * 1024U;
+
+//! Check, if [_begin, _end) starts with the string literal _prefix.
+template <size_t N>
+bool starts_with(
+      const char *_begin, const char *_end, const char (&_prefix)[N]) {
+   return (size_t(_end - _begin) >= N - 1) &&
+         (::memcmp(_begin, _prefix, N - 1) == 0);
+}
+
+//! The end of the line starting at _line without the '\n' and an optional
+//! '\r' (STOMP 1.2).
+const char *line_end(const char *_line, const char *_lf) {
+   return ((_lf != _line) && (_lf[-1] == '\r')) ? _lf - 1 : _lf;
+}
+} // namespace
+
+SuS::logfile::stomp_frame_parser::stomp_frame_parser(
+      sink_t _sink, size_t _chunk_size)
+   : m_sink(std::move(_sink)), m_chunk_size(_chunk_size),
+     m_buffer(_chunk_size) {
+} // stomp_frame_parser constructor
+
+char *SuS::logfile::stomp_frame_parser::prepare() {
+   if (m_buffer.size() - m_end < m_chunk_size) {
+      if (m_begin > 0) {
+         // move the incomplete frame to the front of the buffer.
+         ::memmove(m_buffer.data(), m_buffer.data() + m_begin, m_end - m_begin);
+         m_end -= m_begin;
+         m_scanned -= m_begin;
+         if (m_body != npos) {
+            m_body -= m_begin;
+         }
+         m_begin = 0U;
+      }
+      if (m_buffer.size() - m_end < m_chunk_size) {
+         // a single frame larger than the buffer.
+         m_buffer.resize(m_end + m_chunk_size);
+      }
+   }
+   return m_buffer.data() + m_end;
+} // stomp_frame_parser::prepare
+
+size_t SuS::logfile::stomp_frame_parser::space() const {
+   return m_buffer.size() - m_end;
+} // stomp_frame_parser::space
+
+bool SuS::logfile::stomp_frame_parser::commit(size_t _len) {
+   m_end += _len;
+   const auto buf = m_buffer.data();
+   while (m_begin != m_end) {
+      if (m_body == npos) {
+         if (m_scanned == m_begin) {
+            // not in the middle of a frame => EOLs are heart-beats.
+            while ((m_begin != m_end) &&
+                  ((buf[m_begin] == '\n') || (buf[m_begin] == '\r'))) {
+               ++m_begin;
+            }
+            m_scanned = m_begin;
+            if (m_begin == m_end) {
+               break;
+            }
+         }
+         m_data_seen = true;
+         if (!scan_headers()) {
+            return false;
+         }
+         if (m_body == npos) {
+            // the headers are incomplete.
+            break;
+         }
+      }
+
+      size_t nul;
+      if (m_content_length != npos) {
+         // the body does not need to be scanned.
+         nul = m_body + m_content_length;
+         if (nul >= m_end) {
+            break;
+         }
+         if (buf[nul] != '\0') {
+            // the frame has to end right after the body.
+            return false;
+         }
+      } else {
+         const auto from = std::max(m_scanned, m_body);
+         const auto p = static_cast<const char *>(
+               ::memchr(buf + from, '\0', m_end - from));
+         if (!p) {
+            // incomplete frame. continue scanning here with the next data.
+            m_scanned = m_end;
+            break;
+         }
+         nul = size_t(p - buf);
+      }
+      const auto ok = parse_frame(buf + m_begin, buf + m_body, buf + nul);
+      m_begin = nul + 1;
+      m_scanned = m_begin;
+      m_body = npos;
+      m_content_length = npos;
+      if (!ok) {
+         return false;
+      }
+   }
+   if (m_begin == m_end) {
+      // everything processed => start at the front again.
+      m_begin = m_end = m_scanned = 0U;
+   }
+   return true;
+} // stomp_frame_parser::commit
+
+bool SuS::logfile::stomp_frame_parser::scan_headers() {
+   // m_scanned is always at the start of a line here, so a partial line is
+   // looked at again with the next data. header lines are short.
+   const auto buf = m_buffer.data();
+   while (true) {
+      const auto line = buf + m_scanned;
+      const auto lf =
+            static_cast<const char *>(::memchr(line, '\n', m_end - m_scanned));
+      if (!lf) {
+         return true;
+      }
+      if (::memchr(line, '\0', lf - line)) {
+         // the frame ended within the headers.
+         return false;
+      }
+      m_scanned = size_t(lf - buf) + 1;
+      const auto end = line_end(line, lf);
+      if (end == line) {
+         // empty line => end of headers
+         m_body = m_scanned;
+         return true;
+      }
+      // the first of repeated headers counts.
+      if ((m_content_length == npos) && (line != buf + m_begin) &&
+            starts_with(line, end, s_content_length_key)) {
+         auto len = size_t{0U};
+         auto p = line + sizeof s_content_length_key - 1;
+         if (p == end) {
+            return false;
+         }
+         for (; p != end; ++p) {
+            if ((*p < '0') || (*p > '9')) {
+               return false;
+            }
+            len = len * 10U + size_t(*p - '0');
+            if (len > s_max_content_length) {
+               return false;
+            }
+         }
+         m_content_length = len;
+      }
+   }
+} // stomp_frame_parser::scan_headers
+
+bool SuS::logfile::stomp_frame_parser::feed(const char *_data, size_t _len) {
+   while (_len) {
+      const auto dst = prepare();
+      const auto n = std::min(_len, space());
+      ::memcpy(dst, _data, n);
+      if (!commit(n)) {
+         return false;
+      }
+      _data += n;
+      _len -= n;
+   }
+   return true;
+} // stomp_frame_parser::feed
+
+bool SuS::logfile::stomp_frame_parser::take_data_seen() {
+   const auto ret = m_data_seen;
+   m_data_seen = false;
+   return ret;
+} // stomp_frame_parser::take_data_seen
+
+void SuS::logfile::stomp_frame_parser::reset() {
+   m_begin = m_end = m_scanned = 0U;
+   m_body = m_content_length = npos;
+   m_data_seen = false;
+} // stomp_frame_parser::reset
+
+bool SuS::logfile::stomp_frame_parser::decode_header(
+      const char *_begin, const char *_end, std::string &_out) {
+   _out.clear();
+   auto run_start = _begin;
+   for (auto p = _begin; p != _end; ++p) {
+      if (*p != '\\') {
+         continue;
+      }
+      _out.append(run_start, p);
+      if (++p == _end) {
+         return false;
+      }
+      switch (*p) {
+      case 'r':
+         _out.push_back('\r');
+         break;
+      case 'n':
+         _out.push_back('\n');
+         break;
+      case 'c':
+         _out.push_back(':');
+         break;
+      case '\\':
+         _out.push_back('\\');
+         break;
+      default:
+         // undefined escape sequences are fatal according to the spec.
+         return false;
+      }
+      run_start = p + 1;
+   }
+   _out.append(run_start, _end);
+   return true;
+} // stomp_frame_parser::decode_header
+
+bool SuS::logfile::stomp_frame_parser::parse_frame(
+      const char *_begin, const char *_body, const char *_end) {
+   // first line is the command.
+   const auto lf =
+         static_cast<const char *>(::memchr(_begin, '\n', _body - _begin));
+   const auto cmd_end = line_end(_begin, lf);
+   const auto cmd_len = size_t(cmd_end - _begin);
+   if ((cmd_len == sizeof s_receipt_command - 1) &&
+         (::memcmp(_begin, s_receipt_command, cmd_len) == 0)) {
+      return parse_receipt(lf + 1, _body);
+   }
+   m_frame.command.assign(_begin, cmd_len);
+   return parse_generic(lf + 1, _body, _end);
+} // stomp_frame_parser::parse_frame
+
+bool SuS::logfile::stomp_frame_parser::parse_receipt(
+      const char *_begin, const char *_body) {
+   // short strings => no allocation.
+   m_frame.command.assign(s_receipt_command);
+   m_frame.headers.clear();
+   m_frame.body.clear();
+   m_frame.has_receipt_id = false;
+   m_frame.receipt_id = 0U;
+
+   const auto key_len = sizeof s_receipt_id_key - 1;
+   for (auto line = _begin; line != _body;) {
+      const auto lf =
+            static_cast<const char *>(::memchr(line, '\n', _body - line));
+      const auto end = line_end(line, lf);
+      // repeated keys are ignored => only the first receipt-id counts.
+      if (!m_frame.has_receipt_id && (size_t(end - line) > key_len) &&
+            (::memcmp(line, s_receipt_id_key, key_len) == 0)) {
+         auto value = 0UL;
+         auto p = line + key_len;
+         for (; (p != end) && (*p >= '0') && (*p <= '9'); ++p) {
+            value = value * 10U + unsigned(*p - '0');
+         }
+         // not a number => not one of our receipts.
+         m_frame.has_receipt_id = (p == end);
+         m_frame.receipt_id = value;
+      }
+      line = lf + 1;
+   }
+   return m_sink(m_frame);
+} // stomp_frame_parser::parse_receipt
+
+bool SuS::logfile::stomp_frame_parser::parse_generic(
+      const char *_begin, const char *_body, const char *_end) {
+   m_frame.headers.clear();
+   m_frame.has_receipt_id = false;
+   m_frame.receipt_id = 0U;
+
+   // the spec excludes CONNECT and CONNECTED from the escaping, for
+   // compatibility with STOMP 1.0.
+   const auto decode = (m_frame.command != s_connected_command);
+   std::string key, value;
+   for (auto line = _begin; line != _body;) {
+      const auto lf =
+            static_cast<const char *>(::memchr(line, '\n', _body - line));
+      const auto end = line_end(line, lf);
+      if (end == line) {
+         // the empty line before the body
+         break;
+      }
+      const auto colon =
+            static_cast<const char *>(::memchr(line, ':', end - line));
+      if (!colon) {
+         // no ':' in a header line
+         return false;
+      }
+      if (decode) {
+         if (!decode_header(line, colon, key) ||
+               !decode_header(colon + 1, end, value)) {
+            return false;
+         }
+      } else {
+         key.assign(line, colon);
+         value.assign(colon + 1, end);
+      }
+      // emplace does not overwrite => repeated keys are ignored.
+      m_frame.headers.emplace(key, value);
+      line = lf + 1;
+   }
+   m_frame.body.assign(_body, _end);
+   return m_sink(m_frame);
+} // stomp_frame_parser::parse_generic
@@ -0,0 +1,134 @@
+/* SPDX-License-Identifier: MIT */
+/*! @file */
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace SuS {
+namespace logfile {
+
+//! A frame received from a STOMP server.
+struct stomp_frame {
+   std::string command;
+   //! Only filled for frames other than RECEIPT.
+   std::map<std::string, std::string> headers;
+   //! Only filled for frames other than RECEIPT.
+   std::string body;
+   //! Value of the receipt-id header of a RECEIPT frame.
+   unsigned long receipt_id{0U};
+   //! True, if receipt_id holds a valid value.
+   bool has_receipt_id{false};
+};
+
+//! Incremental parser for the frames sent by a STOMP server.
+/*!
+ * The parser owns the receive buffer, so that data can be read from the
+ * socket directly into it (see \ref prepare and \ref commit). Complete
+ * frames are handed to the sink given to the constructor.
+ *
+ * RECEIPT frames, which are the vast majority of what a log sink receives,
+ * are recognized without allocating: only the receipt-id header is looked
+ * at, and it is converted to an integer. All other frames (CONNECTED,
+ * ERROR, ...) are parsed completely.
+ *
+ * Heart-beats (single '\\n' or "\\r\\n" between frames) are skipped.
+ *
+ * Frames are parsed according to STOMP 1.2, which is compatible with 1.1:
+ * lines may end in "\\r\\n", header values are decoded (except in
+ * CONNECTED frames), and when a frame has a content-length header, the body
+ * is taken by length instead of being scanned for the terminating '\\0'.
+ */
+class stomp_frame_parser {
+ public:
+   //! Called for every complete frame. Return false to stop parsing.
+   typedef std::function<bool(const stomp_frame &)> sink_t;
+
+   //! Initialize the parser.
+   /*!
+    * @param _sink Function to call for every complete frame.
+    * @param _chunk_size Minimum free space provided by \ref prepare.
+    */
+   stomp_frame_parser(sink_t _sink, size_t _chunk_size = 16384);
+
+   //! Get a pointer to free space in the receive buffer.
+   /*!
+    * At least \ref space bytes can be written to the returned pointer.
+    */
+   char *prepare();
+   //! Number of bytes that can be written to the pointer from \ref prepare.
+   size_t space() const;
+   //! Parse _len bytes that have been written to the buffer.
+   /*!
+    * @return False on a protocol error, or when the sink returned false.
+    */
+   bool commit(size_t _len);
+
+   //! Copy _len bytes into the buffer and parse them.
+   /*!
+    * Convenience function for data that is not read into \ref prepare.
+    */
+   bool feed(const char *_data, size_t _len);
+
+   //! Check, if anything but heart-beats has been received.
+   /*!
+    * The flag is reset by this call.
+    */
+   bool take_data_seen();
+
+   //! Drop all buffered data, e.g. after a reconnect.
+   void reset();
+
+ private:
+   //! Look for the end of the headers of the current frame.
+   /*!
+    * Sets m_body when the empty line has been found and m_content_length
+    * when a content-length header has been seen.
+    * @return False on a protocol error.
+    */
+   bool scan_headers();
+
+   //! Parse a complete frame in [_begin, _end), _end pointing to the '\\0'.
+   /*!
+    * @param _body Start of the body, right after the empty line.
+    */
+   bool parse_frame(const char *_begin, const char *_body, const char *_end);
+   bool parse_receipt(const char *_begin, const char *_body);
+   bool parse_generic(const char *_begin, const char *_body, const char *_end);
+   //! Undo the escaping of a header key or value.
+   /*!
+    * @return False for an undefined escape sequence.
+    */
+   static bool decode_header(
+         const char *_begin, const char *_end, std::string &_out);
+
+   static const size_t npos = size_t(-1);
+
+   const sink_t m_sink;
+   const size_t m_chunk_size;
+
+   //! The receive buffer.
+   std::vector<char> m_buffer;
+   //! Start of the first unprocessed byte in m_buffer.
+   size_t m_begin{0U};
+   //! End of the valid data in m_buffer.
+   size_t m_end{0U};
+   //! Bytes before this offset have already been scanned: for the end of
+   //! the headers, or for the '\\0' after the body.
+   size_t m_scanned{0U};
+   //! Offset of the body of the current frame, npos while in the headers.
+   size_t m_body{npos};
+   //! Value of the content-length header of the current frame, or npos.
+   size_t m_content_length{npos};
+
+   bool m_data_seen{false};
+
+   //! Reused for every frame to avoid allocations.
+   stomp_frame m_frame;
+}; // class stomp_frame_parser
+
+} // namespace logfile
+} // namespace SuS
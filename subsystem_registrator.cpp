@@ -11,3 +11,15 @@ void SuS::logfile::subsystem_registrator::set_min_log_level(
    SuS::logfile::logger::instance()->set_subsystem_min_log_level(
          m_subsystem, _level);
 } // subsystem_registrator::set_min_log_level
+
+void SuS::logfile::subsystem_registrator::set_sampling(
+      unsigned _one_in, logger::log_level _max_level) {
+   SuS::logfile::logger::instance()->set_subsystem_sampling(
+         m_subsystem, _one_in, _max_level);
+} // subsystem_registrator::set_sampling
+
+void SuS::logfile::subsystem_registrator::set_rate_limit(
+      double _per_second, unsigned _burst) {
+   SuS::logfile::logger::instance()->set_subsystem_rate_limit(
+         m_subsystem, _per_second, _burst);
+} // subsystem_registrator::set_rate_limit
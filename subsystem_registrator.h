@@ -53,6 +53,13 @@ class LOGFILE_EXPORT subsystem_registrator {
 
    void set_min_log_level(logger::log_level _level);
 
+   //! See logger::set_subsystem_sampling.
+   void set_sampling(unsigned _one_in,
+         logger::log_level _max_level = logger::log_level::finer);
+
+   //! See logger::set_subsystem_rate_limit.
+   void set_rate_limit(double _per_second, unsigned _burst = 1U);
+
  private:
    SuS::logfile::logger::subsystem_t m_subsystem;
 }; // class subsystem_registrator
@@ -1,5 +1,7 @@
 /* SPDX-License-Identifier: MIT */
 #include "tcp_client_socket.h"
+#include "dns_cache.h"
+#include "fd_poller.h"
 #include "logger.h"
 #include "subsystem_registrator.h"
 #include "tcs_private.h"
@@ -10,9 +12,13 @@
 #include <arpa/inet.h>
 #endif
 
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <chrono>
 #include <iterator>
 #include <map>
+#include <mutex>
 
 #ifdef HAVE_NETDB_H
 #include <netdb.h>
@@ -43,6 +49,21 @@
 #include <sys/types.h>
 #endif
 
+#ifdef HAVE_SYS_UN_H
+#include <sys/un.h>
+#endif
+
+#ifdef HAVE_NETINET_TCP_H
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+#if defined HAVE_POLL_H && defined HAVE_FCNTL_H && !defined _WINDOWS
+#include <fcntl.h>
+#include <poll.h>
+#define USE_NONBLOCKING_CONNECT
+#endif
+
 #ifdef HAVE_INET_NTOP
 #include <arpa/inet.h>
 #endif
@@ -81,6 +102,35 @@ std::map<uint8_t, const std::string> s_SOCKS_messages = {{0x00, "succeeded"},
       {0x07, "Command not supported"}, {0x08, "Address type not supported"}};
 
 SuS::logfile::subsystem_registrator log_id{"TCPSocket"};
+
+std::string error_string(int _errno) {
+#ifdef HAVE_STRERROR_R
+   char errstr[256];
+#ifdef STRERROR_R_CHAR_P
+   return ::strerror_r(_errno, errstr, sizeof errstr);
+#else
+   if (::strerror_r(_errno, errstr, sizeof errstr) == 0) {
+      return errstr;
+   }
+   return "error " + std::to_string(_errno);
+#endif
+#else
+   return ::strerror(_errno);
+#endif
+}
+
+void close_socket(SOCKET _socket) {
+#ifdef _WINDOWS
+   ::closesocket(_socket);
+#else
+   ::close(_socket);
+#endif
+}
+
+#ifdef OPENSSL_FOUND
+//! The SSL context shared by all sockets. Initialized by init_OpenSSL().
+SSL_CTX *s_ssl_ctx = nullptr;
+#endif
 }
 
 SuS::logfile::tcp_client_socket::tcp_client_socket(
@@ -113,38 +163,83 @@ SuS::logfile::tcp_client_socket::tcp_client_socket(
 
 SuS::logfile::tcp_client_socket::~tcp_client_socket() {
    disconnect();
+#ifdef OPENSSL_FOUND
+   if (m_d->m_ssl_session) {
+      ::SSL_SESSION_free(m_d->m_ssl_session);
+   }
+#endif
 }
 
 void SuS::logfile::tcp_client_socket::connect() {
+   try {
+#ifdef HAVE_SYS_UN_H
+      if (!m_d->m_unix_path.empty()) {
+         connect_unix();
+      } else
+#endif
+      {
+         connect_tcp();
+      }
+
+#ifdef USE_NONBLOCKING_CONNECT
+      // from now on, read() and write() wait for the socket themselves with
+      // a timeout, so that a stalled peer cannot block the caller forever.
+      // this includes the handshakes below.
+      const auto flags = ::fcntl(m_d->m_socket, F_GETFL, 0);
+      if (flags != -1) {
+         ::fcntl(m_d->m_socket, F_SETFL, flags | O_NONBLOCK);
+      }
+#endif
+
+      // a server accepting the connection but never answering must not
+      // make the handshakes take longer than a connection attempt.
+      m_d->m_handshake = (m_d->m_connect_timeout_ms != 0U);
+      m_d->m_handshake_deadline = std::chrono::steady_clock::now() +
+            std::chrono::milliseconds(m_d->m_connect_timeout_ms);
+      if (m_d->m_use_socks && m_d->m_unix_path.empty()) {
+         start_SOCKS();
+      }
+#ifdef OPENSSL_FOUND
+      if (m_d->m_use_ssl) {
+         start_SSL();
+      }
+#endif
+      m_d->m_handshake = false;
+   } catch (...) {
+      m_d->m_handshake = false;
+      // a failed SOCKS or SSL handshake leaves the socket and the SSL
+      // object behind, and the next connect() would leak them.
+      disconnect();
+      throw;
+   }
+}
+
+void SuS::logfile::tcp_client_socket::connect_tcp() {
    // when using SOCKS, we need to establish the connection to the SOCKS
    // service.
    const auto host = m_d->m_use_socks ? m_d->m_socks_host : m_d->m_host;
    const auto port = m_d->m_use_socks ? m_d->m_socks_port : m_d->m_port;
 
 #if defined HAVE_GETADDRINFO || defined _WINDOWS
-   ::addrinfo hints, *res;
-   ::memset(&hints, 0, sizeof hints);
-   hints.ai_family = AF_UNSPEC;
-   hints.ai_socktype = SOCK_STREAM;
-
-   const auto status = ::getaddrinfo(
-         host.c_str(), std::to_string(port).c_str(), &hints, &res);
-   if (status != 0) {
-      auto error = std::string{"getaddrinfo("};
-      error += host + ") failed: " + ::gai_strerror(status);
-      SuS_LOG(warning, log_id(), error);
-      throw std::runtime_error{error};
-   }
-
-   // iterate over all returned IPs
-   for (const auto *p = res; p; p = p->ai_next) {
-      if (connect_to_ip(p->ai_family, p->ai_socktype, p->ai_protocol,
-                p->ai_addr, p->ai_addrlen)) {
-         // accept the first that results in an established connection.
-         break;
+   // usually answered from the cache without waiting for the resolver.
+   const auto addresses = dns_cache::instance()->resolve(host, port);
+   const auto res = addresses.get();
+
+#ifdef USE_NONBLOCKING_CONNECT
+   if (m_d->m_connect_timeout_ms) {
+      connect_race(res);
+   } else
+#endif
+   {
+      // iterate over all returned IPs
+      for (const auto *p = res; p; p = p->ai_next) {
+         if (connect_to_ip(p->ai_family, p->ai_socktype, p->ai_protocol,
+                   p->ai_addr, p->ai_addrlen)) {
+            // accept the first that results in an established connection.
+            break;
+         }
       }
    }
-   ::freeaddrinfo(res);
 
    if (m_d->m_socket == INVALID_SOCKET) {
       throw std::runtime_error{"Could not connect."};
@@ -165,27 +260,53 @@ void SuS::logfile::tcp_client_socket::connect() {
    }
 #endif
 
-   if (m_d->m_use_socks) {
-      start_SOCKS();
+   set_socket_options();
+}
+
+#ifdef HAVE_SYS_UN_H
+void SuS::logfile::tcp_client_socket::connect_unix() {
+   const auto &path = m_d->m_unix_path;
+   ::sockaddr_un addr;
+   ::memset(&addr, 0, sizeof addr);
+   addr.sun_family = AF_UNIX;
+   if (path.size() >= sizeof addr.sun_path) {
+      throw std::runtime_error{"Socket path too long: " + path};
    }
+   ::memcpy(addr.sun_path, path.data(), path.size());
 
-#ifdef OPENSSL_FOUND
-   if (m_d->m_use_ssl) {
-      start_SSL();
+   SuS_LOG_STREAM(info, log_id(), "Connecting to " << path << ".");
+   const auto fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+   if (fd == INVALID_SOCKET) {
+      throw std::runtime_error{
+            "Could not create socket: " + error_string(errno)};
    }
+   // a local connect does not wait for the network => no need for a
+   // non-blocking connect with timeout.
+   if (::connect(fd, reinterpret_cast<::sockaddr *>(&addr), sizeof addr) !=
+         0) {
+      const auto err = errno;
+      close_socket(fd);
+      throw std::runtime_error{
+            "Could not connect to " + path + ": " + error_string(err)};
+   }
+#ifdef USE_SO_NOSIGPIPE
+   const auto val = int{1};
+   ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &val, sizeof val);
 #endif
+   m_d->m_socket = fd;
+   SuS_LOG(finer, log_id(), "Connected.");
 }
+#endif
 
-bool SuS::logfile::tcp_client_socket::connect_to_ip(int _ai_family,
-      int _socktype, int _protocol, ::sockaddr *_ai_addr,
-      ::socklen_t _ai_addrlen) {
+void SuS::logfile::tcp_client_socket::log_connect_attempt(
+      int _ai_family, const ::sockaddr *_ai_addr) {
 #ifdef HAVE_INET_NTOP
    char ipstr[INET6_ADDRSTRLEN];
-   void *src = nullptr;
+   const void *src = nullptr;
    if (_ai_family == AF_INET)
-      src = &((reinterpret_cast<::sockaddr_in *>(_ai_addr))->sin_addr);
+      src = &((reinterpret_cast<const ::sockaddr_in *>(_ai_addr))->sin_addr);
    else if (_ai_family == AF_INET6)
-      src = &((reinterpret_cast<::sockaddr_in6 *>(_ai_addr))->sin6_addr);
+      src = &((reinterpret_cast<const ::sockaddr_in6 *>(_ai_addr))->sin6_addr);
    if (src && inet_ntop(_ai_family, src, ipstr, sizeof ipstr)) {
       if (m_d->m_use_socks) {
          SuS_LOG_STREAM(info, log_id(), "Connecting to SOCKS server "
@@ -198,6 +319,12 @@ bool SuS::logfile::tcp_client_socket::connect_to_ip(int _ai_family,
       }
    }
 #endif
+}
+
+bool SuS::logfile::tcp_client_socket::connect_to_ip(int _ai_family,
+      int _socktype, int _protocol, ::sockaddr *_ai_addr,
+      ::socklen_t _ai_addrlen) {
+   log_connect_attempt(_ai_family, _ai_addr);
 
    m_d->m_socket = ::socket(_ai_family, _socktype, _protocol);
    if (m_d->m_socket < 0) {
@@ -214,34 +341,227 @@ bool SuS::logfile::tcp_client_socket::connect_to_ip(int _ai_family,
 #endif
 
    if (::connect(m_d->m_socket, _ai_addr, _ai_addrlen) != 0) {
-#ifdef HAVE_STRERROR_R
-      char errstr[256];
-#ifdef STRERROR_R_CHAR_P
-      SuS_LOG_STREAM(warning, log_id(), "Connection failed: " << ::strerror_r(
-                                              errno, errstr, sizeof errstr));
-#else
-      if (::strerror_r(errno, errstr, sizeof errstr) == 0) {
-         SuS_LOG_STREAM(warning, log_id(), "Connection failed: " << errstr);
-      }
-#endif
-#else
       SuS_LOG_STREAM(
-            warning, log_id(), "Connection failed: " << ::strerror(errno));
-#endif
+            warning, log_id(), "Connection failed: " << error_string(errno));
+      close_socket(m_d->m_socket);
+      m_d->m_socket = INVALID_SOCKET;
+      return false;
+   }
+   SuS_LOG(finer, log_id(), "Connected.");
+   return true;
+}
 
-#ifdef _WINDOWS
-      ::closesocket(m_d->m_socket);
-#else
-      ::close(m_d->m_socket);
+#ifdef USE_NONBLOCKING_CONNECT
+bool SuS::logfile::tcp_client_socket::connect_race(const ::addrinfo *_res) {
+   // order the addresses as suggested by RFC 8305 ("Happy Eyeballs"):
+   // alternate between the address families, starting with the family of
+   // the first address returned by getaddrinfo.
+   std::vector<const ::addrinfo *> first, second;
+   for (const auto *p = _res; p; p = p->ai_next) {
+      if (p->ai_family == _res->ai_family) {
+         first.push_back(p);
+      } else {
+         second.push_back(p);
+      }
+   }
+   std::vector<const ::addrinfo *> addrs;
+   for (size_t i = 0U; i < std::max(first.size(), second.size()); ++i) {
+      if (i < first.size()) {
+         addrs.push_back(first[i]);
+      }
+      if (i < second.size()) {
+         addrs.push_back(second[i]);
+      }
+   }
+
+   typedef std::chrono::steady_clock clock;
+   const auto timeout = std::chrono::milliseconds(m_d->m_connect_timeout_ms);
+   const auto stagger = std::chrono::milliseconds(m_d->m_connect_stagger_ms);
+
+   // the connection attempts in flight.
+   std::vector<::pollfd> pending;
+   std::vector<clock::time_point> deadlines;
+   auto winner = SOCKET{INVALID_SOCKET};
+   size_t next = 0U;
+   auto next_start = clock::now();
+
+   const auto drop = [&](size_t _i) {
+      close_socket(pending[_i].fd);
+      pending.erase(pending.begin() + _i);
+      deadlines.erase(deadlines.begin() + _i);
+      // a failed attempt => do not wait for the stagger delay.
+      next_start = clock::now();
+   };
+
+   while (winner == INVALID_SOCKET) {
+      auto now = clock::now();
+      if ((next < addrs.size()) && ((now >= next_start) || pending.empty())) {
+         // start the next attempt.
+         const auto p = addrs[next++];
+         log_connect_attempt(p->ai_family, p->ai_addr);
+         const auto fd = ::socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+         if (fd < 0) {
+            continue;
+         }
+         const auto flags = ::fcntl(fd, F_GETFL, 0);
+         auto ok = (flags != -1) &&
+               (::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0);
+#ifdef USE_SO_NOSIGPIPE
+         const auto val = int{1};
+         ok = ok &&
+               (::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &val, sizeof val) ==
+                     0);
 #endif
-      m_d->m_socket = INVALID_SOCKET;
+         if (!ok) {
+            close_socket(fd);
+            continue;
+         }
+         if (::connect(fd, p->ai_addr, p->ai_addrlen) == 0) {
+            // e.g. connections to localhost might succeed immediately.
+            winner = fd;
+            break;
+         }
+         if (errno != EINPROGRESS) {
+            SuS_LOG_STREAM(warning, log_id(),
+                  "Connection failed: " << error_string(errno));
+            close_socket(fd);
+            continue;
+         }
+         pending.push_back(::pollfd{fd, POLLOUT, 0});
+         deadlines.push_back(now + timeout);
+         next_start = now + stagger;
+         continue;
+      }
+      if (pending.empty()) {
+         // all addresses tried.
+         break;
+      }
+
+      // wait for the first attempt to finish, the next attempt to be
+      // started, or the first attempt to time out.
+      auto wake = *std::min_element(deadlines.begin(), deadlines.end());
+      if (next < addrs.size()) {
+         wake = std::min(wake, next_start);
+      }
+      const auto wait_ms =
+            std::chrono::duration_cast<std::chrono::milliseconds>(wake - now)
+                  .count();
+      const auto rc = ::poll(pending.data(), pending.size(),
+            int(std::max<decltype(wait_ms)>(wait_ms, 0) + 1));
+      if ((rc < 0) && (errno != EINTR)) {
+         SuS_LOG_STREAM(
+               warning, log_id(), "poll failed: " << error_string(errno));
+         break;
+      }
+
+      now = clock::now();
+      // backwards, so that drop() does not disturb the iteration.
+      for (auto i = pending.size(); i-- > 0U;) {
+         if (pending[i].revents) {
+            int err = 0;
+            ::socklen_t len = sizeof err;
+            if (::getsockopt(pending[i].fd, SOL_SOCKET, SO_ERROR, &err, &len) !=
+                  0) {
+               err = errno;
+            }
+            if (err == 0) {
+               winner = pending[i].fd;
+               pending.erase(pending.begin() + i);
+               deadlines.erase(deadlines.begin() + i);
+               break;
+            }
+            SuS_LOG_STREAM(warning, log_id(),
+                  "Connection failed: " << error_string(err));
+            drop(i);
+         } else if (now >= deadlines[i]) {
+            SuS_LOG(warning, log_id(), "Connection timed out.");
+            drop(i);
+         }
+      }
+   }
+
+   // cancel the attempts that lost the race.
+   for (const auto &i : pending) {
+      close_socket(i.fd);
+   }
+   if (winner == INVALID_SOCKET) {
       return false;
    }
+   // stays non-blocking, see connect().
+   m_d->m_socket = winner;
    SuS_LOG(finer, log_id(), "Connected.");
    return true;
 }
+#endif
+
+void SuS::logfile::tcp_client_socket::set_socket_options() {
+   if (!m_d->m_keepalive_idle_s) {
+      return;
+   }
+   // detect a dead peer within seconds instead of the system default of
+   // usually two hours. failures are not fatal, the connection just
+   // falls back to the system defaults.
+   const auto on = int{1};
+   ::setsockopt(m_d->m_socket, SOL_SOCKET, SO_KEEPALIVE,
+         reinterpret_cast<const char *>(&on), sizeof on);
+#if defined TCP_KEEPIDLE || defined TCP_KEEPALIVE
+   const auto idle = int(m_d->m_keepalive_idle_s);
+#ifdef TCP_KEEPIDLE
+   ::setsockopt(m_d->m_socket, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof idle);
+#else
+   // macOS
+   ::setsockopt(m_d->m_socket, IPPROTO_TCP, TCP_KEEPALIVE, &idle, sizeof idle);
+#endif
+#endif
+#ifdef TCP_KEEPINTVL
+   const auto interval = int(m_d->m_keepalive_idle_s);
+   ::setsockopt(m_d->m_socket, IPPROTO_TCP, TCP_KEEPINTVL, &interval,
+         sizeof interval);
+#endif
+#ifdef TCP_KEEPCNT
+   const auto count = int{3};
+   ::setsockopt(m_d->m_socket, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof count);
+#endif
+#ifdef TCP_USER_TIMEOUT
+   // also covers the case that sent data is not acknowledged.
+   const auto user_timeout = unsigned(m_d->m_user_timeout_ms);
+   ::setsockopt(m_d->m_socket, IPPROTO_TCP, TCP_USER_TIMEOUT, &user_timeout,
+         sizeof user_timeout);
+#endif
+}
+
+void SuS::logfile::tcp_client_socket::set_connect_timeout(
+      unsigned _timeout_ms, unsigned _stagger_ms) {
+   m_d->m_connect_timeout_ms = _timeout_ms;
+   m_d->m_connect_stagger_ms = _stagger_ms;
+}
+
+void SuS::logfile::tcp_client_socket::set_keepalive(
+      unsigned _idle_s, unsigned _user_timeout_ms) {
+   m_d->m_keepalive_idle_s = _idle_s;
+   m_d->m_user_timeout_ms = _user_timeout_ms;
+}
 
 void SuS::logfile::tcp_client_socket::disconnect() {
+#ifdef OPENSSL_FOUND
+   if (m_d->m_ssl) {
+      if (m_d->m_ssl_active) {
+         // send close_notify without waiting for the reply, so that the
+         // session stays resumable.
+         ::SSL_shutdown(m_d->m_ssl);
+         const auto session = ::SSL_get1_session(m_d->m_ssl);
+         if (session) {
+            if (m_d->m_ssl_session) {
+               ::SSL_SESSION_free(m_d->m_ssl_session);
+            }
+            m_d->m_ssl_session = session;
+         }
+      }
+      ::SSL_free(m_d->m_ssl);
+      m_d->m_ssl = nullptr;
+   }
+   m_d->m_ssl_active = false;
+#endif
    // ignore errors. we want to get rid of the connection in any case.
 #ifdef _WINDOWS
    ::closesocket(m_d->m_socket);
@@ -256,14 +576,25 @@ bool SuS::logfile::tcp_client_socket::connected() {
 }
 
 void SuS::logfile::tcp_client_socket::start_SOCKS() {
+   // read() waits for the socket itself, up to the handshake deadline.
+   const auto read_all = [this](uint8_t *_data, unsigned _len) {
+      while (_len) {
+         const auto n = read(_data, _len);
+         if (!n) {
+            throw std::runtime_error{"Connection closed by SOCKS server."};
+         }
+         _data += n;
+         _len -= n;
+      }
+   };
+
    // first handshake: confirm common authentication options.
    // NOTE: we are not compliant to RFC1928 until we support GSSAPI.
    uint8_t hello[]{0x05 /* VER */, 0x01 /* NMETHODS */,
          0x00 /* NO AUTHENTICATION REQUIRED */};
    write(hello, sizeof hello);
-   select_read();
    uint8_t version_select[2]{};
-   read(version_select, 2);
+   read_all(version_select, 2);
    if (version_select[0] != 0x05 /* VERSION */
          || version_select[1] != 0x00 /* NO AUTHENTICATION REQUIRED */) {
       throw std::runtime_error{"SOCKS handshake failed."};
@@ -281,9 +612,8 @@ void SuS::logfile::tcp_client_socket::start_SOCKS() {
    request.push_back(m_d->m_port >> 8);
    request.push_back(m_d->m_port & 0xFF);
    write(request.data(), request.size());
-   select_read();
    uint8_t connect_reply[10]{}; // TODO: reply is actually variable-length
-   read(connect_reply, 10);
+   read_all(connect_reply, 10);
    if (connect_reply[0] != 0x05 /* VERSION */
          || connect_reply[2] != 0x00 /* RSV */) {
       throw std::runtime_error{"SOCKS handshake failed."};
@@ -303,29 +633,134 @@ unsigned SuS::logfile::tcp_client_socket::read(uint8_t *_data, unsigned _len) {
    if (!connected()) {
       throw std::runtime_error{"Not connected."};
    }
+   while (true) {
+#ifdef OPENSSL_FOUND
+      if (m_d->m_ssl_active) {
+         const auto ret = ::SSL_read(m_d->m_ssl, _data, _len);
+         if (ret > 0) {
+            return ret;
+         }
+         // on a non-blocking socket OpenSSL might need to wait for the
+         // socket, even for reading (renegotiation).
+         const auto err = ::SSL_get_error(m_d->m_ssl, ret);
+         if (err == SSL_ERROR_ZERO_RETURN) {
+            return 0U;
+         } else if (err == SSL_ERROR_WANT_READ) {
+            wait_io(fd_poller::readable);
+         } else if (err == SSL_ERROR_WANT_WRITE) {
+            wait_io(fd_poller::writable);
+         } else {
+            throw std::runtime_error{"SSL_read failed."};
+         }
+         continue;
+      }
+#endif
+
+#ifdef _WINDOWS
+      const auto ret =
+            ::recv(m_d->m_socket, reinterpret_cast<char *>(_data), _len, 0);
+#else
+      const auto ret = ::read(m_d->m_socket, _data, _len);
+#endif
+      if (ret >= 0) {
+         return ret;
+      }
+      if (errno == EINTR) {
+         continue;
+      }
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+         wait_io(fd_poller::readable);
+         continue;
+      }
+      throw std::runtime_error{"Read failed."};
+   }
+}
+
+int SuS::logfile::tcp_client_socket::read_some(uint8_t *_data, unsigned _len) {
+   if (!connected()) {
+      throw std::runtime_error{"Not connected."};
+   }
 #ifdef OPENSSL_FOUND
    if (m_d->m_ssl_active) {
       const auto ret = ::SSL_read(m_d->m_ssl, _data, _len);
-      if (ret < 0) {
-         // we run with SSL_MODE_AUTO_RETRY, so OpenSSL cannot request
-         // action from us to complete the read.
-         throw std::runtime_error{"SSL_read failed."};
+      if (ret > 0) {
+         return ret;
       }
-      return ret;
+      const auto err = ::SSL_get_error(m_d->m_ssl, ret);
+      if (err == SSL_ERROR_ZERO_RETURN) {
+         return 0;
+      } else if ((err == SSL_ERROR_WANT_READ) ||
+            (err == SSL_ERROR_WANT_WRITE)) {
+         // the caller is going to be notified when the socket is readable
+         // again, and a blocked renegotiation is continued by the next write.
+         return -1;
+      }
+      throw std::runtime_error{"SSL_read failed."};
    }
 #endif
-
+   while (true) {
 #ifdef _WINDOWS
-   const auto ret =
-         ::recv(m_d->m_socket, reinterpret_cast<char *>(_data), _len, 0);
+      const auto ret =
+            ::recv(m_d->m_socket, reinterpret_cast<char *>(_data), _len, 0);
 #else
-   const auto ret = ::read(m_d->m_socket, _data, _len);
+      const auto ret = ::read(m_d->m_socket, _data, _len);
 #endif
-   if (ret < 0) {
+      if (ret >= 0) {
+         return int(ret);
+      }
+      if (errno == EINTR) {
+         continue;
+      }
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+         return -1;
+      }
       throw std::runtime_error{"Read failed."};
    }
-   return ret;
-}
+} // tcp_client_socket::read_some
+
+unsigned SuS::logfile::tcp_client_socket::write_some(
+      const uint8_t *_data, unsigned _len) {
+   if (!connected()) {
+      throw std::runtime_error{"Not connected"};
+   }
+#ifdef OPENSSL_FOUND
+   if (m_d->m_ssl_active) {
+      const auto ret = ::SSL_write(m_d->m_ssl, _data, _len);
+      if (ret > 0) {
+         return unsigned(ret);
+      }
+      const auto err = ::SSL_get_error(m_d->m_ssl, ret);
+      if ((err == SSL_ERROR_WANT_WRITE) || (err == SSL_ERROR_WANT_READ)) {
+         return 0U;
+      }
+      throw std::runtime_error{"Write failed."};
+   }
+#endif
+   while (true) {
+#ifdef USE_MSG_NOSIGNAL
+      const auto ret = ::send(m_d->m_socket, _data, _len, MSG_NOSIGNAL);
+#elif defined _WINDOWS
+      const auto ret = ::send(
+            m_d->m_socket, reinterpret_cast<const char *>(_data), _len, 0);
+#else
+      const auto ret = ::write(m_d->m_socket, _data, _len);
+#endif
+      if (ret >= 0) {
+         return unsigned(ret);
+      }
+      if (errno == EINTR) {
+         continue;
+      }
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+         return 0U;
+      }
+      throw std::runtime_error{"Write failed."};
+   }
+} // tcp_client_socket::write_some
+
+int SuS::logfile::tcp_client_socket::handle() const {
+   return int(m_d->m_socket);
+} // tcp_client_socket::handle
 
 bool SuS::logfile::tcp_client_socket::select_read(uint_fast64_t _timeout_us) {
    if (!connected()) {
@@ -337,39 +772,62 @@ bool SuS::logfile::tcp_client_socket::select_read(uint_fast64_t _timeout_us) {
       return true;
    }
 #endif
-   ::fd_set master_set;
-   FD_ZERO(&master_set);
-   FD_SET(m_d->m_socket, &master_set);
-   ::fd_set except_set;
-   ::memcpy(&except_set, &master_set, sizeof master_set);
-   ::timeval timeout;
-   timeout.tv_sec = _timeout_us / 1000000U;
-   timeout.tv_usec = _timeout_us % 1000000U;
-   const auto to = (_timeout_us == 0) ? nullptr : &timeout;
-#ifdef _WINDOWS
-   const auto rc = select(1, &master_set, nullptr, &except_set, to);
-#else
-   const auto rc =
-         select(m_d->m_socket + 1, &master_set, nullptr, &except_set, to);
-#endif
-   if (rc < 0) {
-      throw std::runtime_error{"Select failed."};
-   } else if (rc == 0) {
-      // timeout
-      return false;
-   } else if (rc == 1) {
-      if (FD_ISSET(m_d->m_socket, &master_set)) {
-         return true;
-      } else if (FD_ISSET(m_d->m_socket, &except_set)) {
-         throw std::runtime_error{"Exception on the socket."};
-      } else {
-         throw std::runtime_error{"Cannot find what ended select."};
+   const auto ev =
+         fd_poller::wait_one(m_d->m_socket, fd_poller::readable, _timeout_us);
+   if (ev & fd_poller::readable) {
+      // also covers a hang-up, which read() reports as 0 bytes.
+      return true;
+   } else if (ev & fd_poller::error) {
+      throw std::runtime_error{"Exception on the socket."};
+   }
+   // timeout
+   return false;
+}
+
+bool SuS::logfile::tcp_client_socket::select_write(uint_fast64_t _timeout_us) {
+   if (!connected()) {
+      throw std::runtime_error{"Not connected."};
+   }
+   const auto ev =
+         fd_poller::wait_one(m_d->m_socket, fd_poller::writable, _timeout_us);
+   if (ev & fd_poller::writable) {
+      return true;
+   } else if (ev & fd_poller::error) {
+      throw std::runtime_error{"Exception on the socket."};
+   }
+   // timeout
+   return false;
+}
+
+void SuS::logfile::tcp_client_socket::wait_io(unsigned _events) {
+   auto timeout_us = uint_fast64_t(m_d->m_io_timeout_ms) * 1000U;
+   if (m_d->m_handshake) {
+      const auto left = std::chrono::duration_cast<std::chrono::microseconds>(
+            m_d->m_handshake_deadline - std::chrono::steady_clock::now())
+                              .count();
+      if (left <= 0) {
+         throw std::runtime_error{"Handshake timeout."};
+      }
+      if (!timeout_us || (uint_fast64_t(left) < timeout_us)) {
+         timeout_us = uint_fast64_t(left);
       }
-   } else {
-      // one descriptor in the set and more than one set in the result!?
-      throw std::runtime_error{"Cannot understand the result of select."};
    }
+   const auto ev = fd_poller::wait_one(m_d->m_socket, _events, timeout_us);
+   if (ev & _events) {
+      return;
+   } else if (ev & fd_poller::error) {
+      throw std::runtime_error{"Exception on the socket."};
+   }
+   throw std::runtime_error{
+         m_d->m_handshake ? "Handshake timeout." : "I/O timeout."};
+}
+
+#ifdef HAVE_SYS_UN_H
+void SuS::logfile::tcp_client_socket::use_unix_socket(
+      const std::string &_path) {
+   m_d->m_unix_path = _path;
 }
+#endif
 
 void SuS::logfile::tcp_client_socket::use_SOCKS(
       const std::string &_host, uint16_t _port) {
@@ -391,24 +849,59 @@ void SuS::logfile::tcp_client_socket::write(
 
 #ifdef OPENSSL_FOUND
    if (m_d->m_ssl_active) {
-      if (::SSL_write(m_d->m_ssl, _data, _len) != int(_len)) {
-         throw std::runtime_error{"Write failed."};
+      while (_len) {
+         // with SSL_MODE_ENABLE_PARTIAL_WRITE, SSL_write might return after
+         // every record.
+         const auto ret = ::SSL_write(m_d->m_ssl, _data, _len);
+         if (ret > 0) {
+            _data += ret;
+            _len -= unsigned(ret);
+            continue;
+         }
+         // retry with the same arguments after the socket is ready.
+         const auto err = ::SSL_get_error(m_d->m_ssl, ret);
+         if (err == SSL_ERROR_WANT_WRITE) {
+            wait_io(fd_poller::writable);
+         } else if (err == SSL_ERROR_WANT_READ) {
+            wait_io(fd_poller::readable);
+         } else {
+            throw std::runtime_error{"Write failed."};
+         }
       }
       return;
    }
 #endif
 
+   // send() might write less than requested => continue where it stopped.
+   while (_len) {
 #ifdef USE_MSG_NOSIGNAL
-   if (::send(m_d->m_socket, _data, _len, MSG_NOSIGNAL) != _len) {
+      const auto ret = ::send(m_d->m_socket, _data, _len, MSG_NOSIGNAL);
 #elif defined _WINDOWS
-   if (::send(m_d->m_socket, reinterpret_cast<const char *>(_data), _len, 0) != _len) {
+      const auto ret = ::send(
+            m_d->m_socket, reinterpret_cast<const char *>(_data), _len, 0);
 #else
-   if (::write(m_d->m_socket, _data, _len) != _len) {
+      const auto ret = ::write(m_d->m_socket, _data, _len);
 #endif
+      if (ret >= 0) {
+         _data += ret;
+         _len -= unsigned(ret);
+         continue;
+      }
+      if (errno == EINTR) {
+         continue;
+      }
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+         wait_io(fd_poller::writable);
+         continue;
+      }
       throw std::runtime_error{"Write failed."};
    }
 }
 
+void SuS::logfile::tcp_client_socket::set_io_timeout(unsigned _timeout_ms) {
+   m_d->m_io_timeout_ms = _timeout_ms;
+}
+
 #ifdef OPENSSL_FOUND
 void SuS::logfile::tcp_client_socket::use_SSL(bool _self_signed_ok) {
    m_d->m_use_ssl = true;
@@ -416,42 +909,101 @@ void SuS::logfile::tcp_client_socket::use_SSL(bool _self_signed_ok) {
 }
 
 void SuS::logfile::tcp_client_socket::init_OpenSSL() {
-   ::OpenSSL_add_all_algorithms();
-   ::ERR_load_crypto_strings();
-   ::SSL_load_error_strings();
-   if (::SSL_library_init() < 0)
+   // the context is shared by all sockets in the process, so that the
+   // library initialization and the loading of the certificate stores only
+   // happen once.
+   static std::once_flag s_once;
+   std::call_once(s_once, []() {
+      ::OpenSSL_add_all_algorithms();
+      ::ERR_load_crypto_strings();
+      ::SSL_load_error_strings();
+      if (::SSL_library_init() < 0) {
+         SuS_LOG(warning, log_id(), "Failed to initialize OpenSSL.");
+         return;
+      }
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+      s_ssl_ctx = ::SSL_CTX_new(::TLS_client_method());
+#else
+      s_ssl_ctx = ::SSL_CTX_new(::SSLv23_client_method());
+#endif
+      if (!s_ssl_ctx) {
+         SuS_LOG(warning, log_id(), "Could not create SSL context.");
+         return;
+      }
+
+      // tell OpenSSL to take care of handshakes without telling us.
+      // partial writes and moving buffers allow sinks to keep unsent data
+      // in a growing buffer (see write_some()).
+      ::SSL_CTX_set_mode(s_ssl_ctx, SSL_MODE_AUTO_RETRY |
+                  SSL_MODE_ENABLE_PARTIAL_WRITE |
+                  SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+      // disable insecure SSLv2.
+      ::SSL_CTX_set_options(s_ssl_ctx, SSL_OP_NO_SSLv2);
+
+      // we keep the session of the last connection ourselves (see
+      // disconnect()), the internal cache is of no use for a client.
+      ::SSL_CTX_set_session_cache_mode(s_ssl_ctx, SSL_SESS_CACHE_CLIENT |
+                  SSL_SESS_CACHE_NO_INTERNAL_STORE);
+
+      const auto store = ::SSL_CTX_get_cert_store(s_ssl_ctx);
+      auto lookup = ::X509_STORE_add_lookup(store, ::X509_LOOKUP_file());
+      // nullptr + X509_FILETYPE_DEFAULT => default location
+      ::X509_LOOKUP_load_file(lookup, nullptr, X509_FILETYPE_DEFAULT);
+      lookup = ::X509_STORE_add_lookup(store, ::X509_LOOKUP_hash_dir());
+      // nullptr + X509_FILETYPE_DEFAULT => default location
+      ::X509_LOOKUP_add_dir(lookup, nullptr, X509_FILETYPE_DEFAULT);
+   });
+   if (!s_ssl_ctx) {
       throw std::runtime_error{"Failed to initialize OpenSSL."};
+   }
 }
 
 void SuS::logfile::tcp_client_socket::start_SSL() {
    init_OpenSSL();
 
-   if ((m_d->m_ssl_ctx = ::SSL_CTX_new(::SSLv23_client_method())) == nullptr) {
-      throw std::runtime_error{"Could not create SSL context."};
+   m_d->m_ssl = ::SSL_new(s_ssl_ctx);
+   if (!m_d->m_ssl) {
+      throw std::runtime_error{"Could not create SSL object."};
    }
-
-   // tell OpenSSL to take care of handshakes without telling us.
-   ::SSL_CTX_set_mode(m_d->m_ssl_ctx, SSL_MODE_AUTO_RETRY);
-
-   // disable insecure SSLv2.
-   ::SSL_CTX_set_options(m_d->m_ssl_ctx, SSL_OP_NO_SSLv2);
-
-   const auto store = ::SSL_CTX_get_cert_store(m_d->m_ssl_ctx);
-   auto lookup = ::X509_STORE_add_lookup(store, ::X509_LOOKUP_file());
-   // nullptr + X509_FILETYPE_DEFAULT => default location
-   ::X509_LOOKUP_load_file(lookup, nullptr, X509_FILETYPE_DEFAULT);
-   lookup = ::X509_STORE_add_lookup(store, ::X509_LOOKUP_hash_dir());
-   // nullptr + X509_FILETYPE_DEFAULT => default location
-   ::X509_LOOKUP_add_dir(lookup, nullptr, X509_FILETYPE_DEFAULT);
-
-   m_d->m_ssl = ::SSL_new(m_d->m_ssl_ctx);
    ::SSL_set_fd(m_d->m_ssl, m_d->m_socket);
+   if (m_d->m_ssl_session) {
+      // offer the session of the previous connection for resumption.
+      ::SSL_set_session(m_d->m_ssl, m_d->m_ssl_session);
+   }
 
-   if (::SSL_connect(m_d->m_ssl) != 1) {
-      throw std::runtime_error{"Could not establish SSL session."};
+   // the socket is non-blocking => continue whenever it is ready, until
+   // the handshake deadline.
+   while (true) {
+      const auto ret = ::SSL_connect(m_d->m_ssl);
+      if (ret == 1) {
+         break;
+      }
+      const auto err = ::SSL_get_error(m_d->m_ssl, ret);
+      if (err == SSL_ERROR_WANT_READ) {
+         wait_io(fd_poller::readable);
+      } else if (err == SSL_ERROR_WANT_WRITE) {
+         wait_io(fd_poller::writable);
+      } else {
+         throw std::runtime_error{"Could not establish SSL session."};
+      }
+   }
+   if (::SSL_session_reused(m_d->m_ssl)) {
+      // the certificate has been checked when the session was established.
+      SuS_LOG(finer, log_id(), "SSL session resumed.");
+      m_d->m_ssl_active = true;
+      return;
    }
    const auto cert = ::SSL_get_peer_certificate(m_d->m_ssl);
-   SuS_LOG_STREAM(config, log_id(), "name: " << cert->name);
+   if (!cert) {
+      throw std::runtime_error{"No server certificate."};
+   }
+   char cert_name[256];
+   ::X509_NAME_oneline(
+         ::X509_get_subject_name(cert), cert_name, sizeof cert_name);
+   ::X509_free(cert);
+   SuS_LOG_STREAM(config, log_id(), "name: " << cert_name);
 
    const auto verify_result = ::SSL_get_verify_result(m_d->m_ssl);
 
@@ -8,6 +8,9 @@
 #include <memory>
 #include <string>
 
+#ifdef HAVE_NETDB_H
+#include <netdb.h>
+#endif
 #ifdef HAVE_SYS_SOCKET_H
 #include <sys/socket.h>
 #endif
@@ -43,6 +46,14 @@ struct tcs_private;
  *
  * When SSL and SOCKS5 are used together, the encryption is between this
  * socket and the actual server, not the SOCKS server.
+ *
+ * Where supported, connections are established non-blocking with a timeout
+ * per attempt. When a host name resolves to several addresses, the attempts
+ * are started in staggered parallel as described in RFC 8305 ("Happy
+ * Eyeballs"), so that an unreachable IPv6 address does not delay IPv4. The
+ * SOCKS and SSL handshakes that follow get the same timeout, so that a
+ * server accepting connections but never answering does not block
+ * \ref connect.
  */
 class tcp_client_socket {
  public:
@@ -72,12 +83,37 @@ class tcp_client_socket {
 
    //! Read from the socket.
    /*!
+    * Waits for data up to the I/O timeout (see \ref set_io_timeout).
+    *
     * @param _data Pointer to the buffer to read into.
     * @param _len Maximum number of bytes to read.
     * @return Number of bytes read.  0 means the connection has been closed.
     */
    unsigned read(uint8_t *_data, unsigned _len);
 
+   //! Read what is available without waiting.
+   /*!
+    * For use with a readiness notification like \ref net_reactor. Call
+    * until -1 is returned: with SSL, data might be buffered that does not
+    * show up as readable on the socket.
+    *
+    * @return Number of bytes read. 0 means the connection has been closed,
+    * -1 that no data is available at the moment.
+    */
+   int read_some(uint8_t *_data, unsigned _len);
+
+   //! Write as much as possible without waiting.
+   /*!
+    * With SSL, a call that returned 0 must be repeated with the same data
+    * (the buffer may move, though).
+    *
+    * @return Number of bytes written, 0 when the socket is not ready.
+    */
+   unsigned write_some(const uint8_t *_data, unsigned _len);
+
+   //! The descriptor of the connected socket, e.g. to watch it for events.
+   int handle() const;
+
    //! Call select for available data on the socket.
    /*!
     * @param _timeout_us Timeout in microseconds.
@@ -86,13 +122,27 @@ class tcp_client_socket {
     */
    bool select_read(uint_fast64_t _timeout_us = 0);
 
+   //! Wait until data can be written to the socket.
+   /*!
+    * @param _timeout_us Timeout in microseconds. 0 waits forever.
+    * @return True, if the socket is writable. False in case of a timeout.
+    */
+   bool select_write(uint_fast64_t _timeout_us = 0);
+
    //! Write to the socket.
    /*!
+    * Short writes are continued until all data has been sent. When the
+    * socket buffer is full, this waits up to the I/O timeout (see
+    * \ref set_io_timeout) for each chunk.
+    *
     * @param _data Pointer to the first byte to send.
     * @param _len Number of bytes to send.
     */
    void write(const uint8_t *_data, unsigned _len);
 
+   //! Set the time read() and write() wait for the socket to become ready.
+   void set_io_timeout(unsigned _timeout_ms);
+
    //! Enable the SOCKS mode.
    /*!
     * @param _host Host name of the SOCKS server. Empty to disable SOCKS.
@@ -100,15 +150,57 @@ class tcp_client_socket {
     */
    void use_SOCKS(const std::string &_host, uint16_t _port);
 
+#ifdef HAVE_SYS_UN_H
+   //! Connect to a Unix domain stream socket instead of host and port.
+   /*!
+    * DNS, SOCKS and the TCP options are not used in this mode, SSL is.
+    * @param _path Path of the socket. Empty to use TCP again.
+    */
+   void use_unix_socket(const std::string &_path);
+#endif
+
 #ifdef OPENSSL_FOUND
    //! Enable SSL encyrption of the connection.
    void use_SSL(bool _self_signed_ok = false);
 #endif
 
+   //! Configure the non-blocking connection attempts.
+   /*!
+    * @param _timeout_ms Timeout of a single connection attempt, and of the
+    * SOCKS and SSL handshakes together. 0 selects plain blocking connects
+    * to one address after the other, and handshakes limited by the I/O
+    * timeout only.
+    * @param _stagger_ms Delay before the next address is tried in parallel.
+    */
+   void set_connect_timeout(unsigned _timeout_ms, unsigned _stagger_ms = 250);
+
+   //! Configure the detection of dead connections.
+   /*!
+    * Applied on the next connect.
+    * @param _idle_s Idle time before TCP keepalive probes are sent, also used
+    * as the interval between probes. 0 disables keepalive.
+    * @param _user_timeout_ms Maximum time sent data may stay unacknowledged
+    * (TCP_USER_TIMEOUT, where available).
+    */
+   void set_keepalive(unsigned _idle_s, unsigned _user_timeout_ms);
+
  private:
+   //! Resolve the host name and connect via TCP (and SOCKS).
+   void connect_tcp();
+#ifdef HAVE_SYS_UN_H
+   void connect_unix();
+#endif
    //! Try to connect to an IP address.
    bool connect_to_ip(int _ai_family, int _socktype, int _protocol,
          ::sockaddr *_ai_addr, ::socklen_t _ai_addrlen);
+   //! Race non-blocking connection attempts to all addresses in _res.
+   bool connect_race(const ::addrinfo *_res);
+   void log_connect_attempt(int _ai_family, const ::sockaddr *_ai_addr);
+   //! Set keepalive options on the connected socket.
+   void set_socket_options();
+   //! Wait for fd_poller::readable or fd_poller::writable up to the I/O
+   //! timeout. Throws on timeout or error.
+   void wait_io(unsigned _events);
 
    void start_SOCKS();
 
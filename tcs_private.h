@@ -1,6 +1,8 @@
 /* SPDX-License-Identifier: MIT */
 #pragma once
 
+#include <chrono>
+
 #ifndef _WINDOWS
 typedef int SOCKET;
 #endif
@@ -16,14 +18,28 @@ struct tcs_private {
    std::string m_socks_host; ///< Name of the SOCKS server.
    uint16_t m_socks_port;    ///< Port number of the SOCKS service.
 
+   std::string m_unix_path; ///< Unix domain socket to use instead of TCP.
+
    SOCKET m_socket{INVALID_SOCKET}; ///< The socket handle.
 
+   unsigned m_connect_timeout_ms{10000}; ///< Timeout per connection attempt.
+   unsigned m_connect_stagger_ms{250};   ///< Delay between parallel attempts.
+   unsigned m_keepalive_idle_s{10};      ///< TCP keepalive idle/interval.
+   unsigned m_user_timeout_ms{30000};    ///< TCP_USER_TIMEOUT.
+   unsigned m_io_timeout_ms{30000};      ///< Max. wait in read()/write().
+
+   //! The SOCKS and SSL handshakes are running, and m_handshake_deadline
+   //! limits every wait.
+   bool m_handshake{false};
+   std::chrono::steady_clock::time_point m_handshake_deadline;
+
 #ifdef OPENSSL_FOUND
    bool m_use_ssl{false};            ///< Use SSL.
    bool m_ssl_active{false};         ///< An SSL session has been initialized.
    bool m_ssl_self_signed_ok{false}; ///< Accept self-signed certificates.
-   SSL *m_ssl;
-   SSL_CTX *m_ssl_ctx;
+   SSL *m_ssl{nullptr};
+   //! Session of the last connection, offered for resumption.
+   SSL_SESSION *m_ssl_session{nullptr};
 #endif
 };
 